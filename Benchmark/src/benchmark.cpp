@@ -0,0 +1,428 @@
+﻿// Benchmark of indexing, querying and removal on a synthetic corpus.
+// Options are given as --name=value; the results are written as JSON to
+// --output or to the standard output, progress goes to the standard error.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <execution>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "corpus.h"
+#include "process_queries.h"
+#include "search_server.h"
+#include "thread_pool.h"
+
+using namespace std::literals;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double GetSeconds(Clock::time_point start_time) {
+  return std::chrono::duration<double>(Clock::now() - start_time).count();
+}
+
+// Just enough JSON for flat objects of numbers nested in objects.
+class JsonWriter {
+ public:
+  explicit JsonWriter(std::ostream& output) : output_(output) {
+    output_.precision(15);
+  }
+
+  void BeginObject(std::string_view key = {}) {
+    WriteKey(key);
+    output_ << '{';
+    first_in_object_ = true;
+    ++depth_;
+  }
+  void EndObject() {
+    --depth_;
+    output_ << '\n' << std::string(depth_ * 2, ' ') << '}';
+    first_in_object_ = false;
+    if (depth_ == 0) {
+      output_ << '\n';
+    }
+  }
+  void Write(std::string_view key, double value) {
+    WriteKey(key);
+    if (std::isfinite(value)) {
+      output_ << value;
+    } else {
+      output_ << "null";
+    }
+  }
+  void Write(std::string_view key, std::string_view value) {
+    WriteKey(key);
+    output_ << '"' << value << '"';
+  }
+
+ private:
+  std::ostream& output_;
+  int depth_ = 0;
+  bool first_in_object_ = true;
+
+  void WriteKey(std::string_view key) {
+    if (depth_ == 0) {
+      return;
+    }
+    output_ << (first_in_object_ ? "\n" : ",\n")
+            << std::string(depth_ * 2, ' ') << '"' << key << "\": ";
+    first_in_object_ = false;
+  }
+};
+
+void WriteThroughput(JsonWriter& json, std::string_view name, double seconds,
+                     size_t operation_count, size_t byte_count = 0) {
+  json.BeginObject(name);
+  json.Write("count", static_cast<double>(operation_count));
+  json.Write("seconds", seconds);
+  json.Write("per_second", operation_count / seconds);
+  if (byte_count > 0) {
+    json.Write("megabytes_per_second", byte_count / seconds / 1e6);
+  }
+  json.EndObject();
+}
+
+// Latencies in microseconds; percentiles by the nearest rank.
+void WriteLatencies(JsonWriter& json, std::string_view name,
+                    std::vector<double> latencies) {
+  std::sort(latencies.begin(), latencies.end());
+  const auto percentile = [&latencies](double fraction) {
+    const size_t rank = static_cast<size_t>(
+        std::ceil(fraction * static_cast<double>(latencies.size())));
+    return latencies[std::max<size_t>(rank, 1) - 1];
+  };
+  double sum = 0.0;
+  for (const double latency : latencies) {
+    sum += latency;
+  }
+
+  json.BeginObject(name);
+  json.Write("count", static_cast<double>(latencies.size()));
+  if (!latencies.empty()) {
+    json.Write("mean_us", sum / latencies.size());
+    json.Write("p50_us", percentile(0.5));
+    json.Write("p99_us", percentile(0.99));
+    json.Write("p999_us", percentile(0.999));
+    json.Write("max_us", latencies.back());
+  }
+  json.EndObject();
+}
+
+// Stage latencies of the server's own metrics, in microseconds. Written only
+// by builds with SEARCH_SERVER_METRICS defined.
+void WriteMetrics(JsonWriter& json, const SearchMetricsSnapshot& snapshot) {
+  static const std::pair<QueryCounter, std::string_view> COUNTERS[] = {
+      {QueryCounter::QUERIES, "queries"},
+      {QueryCounter::POSTINGS_SCANNED, "postings_scanned"},
+      {QueryCounter::CANDIDATES, "candidates"}};
+  static const std::pair<QueryStage, std::string_view> STAGES[] = {
+      {QueryStage::PARSE, "parse"},
+      {QueryStage::MINUS_FILTER, "minus_filter"},
+      {QueryStage::SCORE, "score"},
+      {QueryStage::TOP_K, "top_k"},
+      {QueryStage::SORT, "sort"}};
+
+  json.BeginObject("metrics");
+  for (const auto& [counter, name] : COUNTERS) {
+    json.Write(name, static_cast<double>(snapshot.Get(counter)));
+  }
+  for (const auto& [stage, name] : STAGES) {
+    const LatencyHistogram& latencies = snapshot.Get(stage);
+    json.BeginObject(name);
+    json.Write("count", static_cast<double>(latencies.GetCount()));
+    json.Write("mean_us", latencies.GetMean() / 1e3);
+    json.Write("p50_us", latencies.GetPercentile(0.5) / 1e3);
+    json.Write("p99_us", latencies.GetPercentile(0.99) / 1e3);
+    json.Write("p999_us", latencies.GetPercentile(0.999) / 1e3);
+    json.Write("max_us", latencies.GetMax() / 1e3);
+    json.EndObject();
+  }
+  json.EndObject();
+}
+
+// Calls operation(i) for every i < count and returns how long each call
+// took, in microseconds.
+std::vector<double> MeasureLatencies(
+    size_t count, const std::function<void(size_t)>& operation) {
+  std::vector<double> latencies;
+  latencies.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    const auto start_time = Clock::now();
+    operation(i);
+    latencies.push_back(GetSeconds(start_time) * 1e6);
+  }
+  return latencies;
+}
+
+struct BenchmarkOptions {
+  CorpusOptions corpus;
+  // Documents removed by each of the removal benchmarks.
+  int removal_count = 2000;
+  // Query and document pairs for MatchDocument.
+  int match_count = 10000;
+  // Workers of the pool the parallel overloads run on; the default pool
+  // when negative.
+  int thread_count = -1;
+  std::string output_path;
+};
+
+bool ParseOptions(int argc, char* argv[], BenchmarkOptions& options) {
+  std::map<std::string, std::function<void(const std::string&)>> parsers = {
+      {"documents",
+       [&](const std::string& value) {
+         options.corpus.document_count = std::stoi(value);
+       }},
+      {"vocabulary",
+       [&](const std::string& value) {
+         options.corpus.vocabulary_size = std::stoi(value);
+       }},
+      {"zipf",
+       [&](const std::string& value) {
+         options.corpus.zipf_exponent = std::stod(value);
+       }},
+      {"min-words",
+       [&](const std::string& value) {
+         options.corpus.min_document_words = std::stoi(value);
+       }},
+      {"max-words",
+       [&](const std::string& value) {
+         options.corpus.max_document_words = std::stoi(value);
+       }},
+      {"stop-words",
+       [&](const std::string& value) {
+         options.corpus.stop_word_count = std::stoi(value);
+       }},
+      {"stop-word-ratio",
+       [&](const std::string& value) {
+         options.corpus.stop_word_ratio = std::stod(value);
+       }},
+      {"queries",
+       [&](const std::string& value) {
+         options.corpus.query_count = std::stoi(value);
+       }},
+      {"query-words",
+       [&](const std::string& value) {
+         options.corpus.max_query_words = std::stoi(value);
+       }},
+      {"minus-word-ratio",
+       [&](const std::string& value) {
+         options.corpus.minus_word_ratio = std::stod(value);
+       }},
+      {"seed",
+       [&](const std::string& value) {
+         options.corpus.seed = static_cast<uint32_t>(std::stoul(value));
+       }},
+      {"removals",
+       [&](const std::string& value) {
+         options.removal_count = std::stoi(value);
+       }},
+      {"matches",
+       [&](const std::string& value) {
+         options.match_count = std::stoi(value);
+       }},
+      {"threads",
+       [&](const std::string& value) {
+         options.thread_count = std::stoi(value);
+       }},
+      {"output",
+       [&](const std::string& value) { options.output_path = value; }},
+  };
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string argument = argv[i];
+    const size_t equals = argument.find('=');
+    const bool is_option =
+        argument.rfind("--", 0) == 0 && equals != std::string::npos;
+    const auto parser = is_option
+                            ? parsers.find(argument.substr(2, equals - 2))
+                            : parsers.end();
+    if (parser == parsers.end()) {
+      std::cerr << "Unknown argument " << argument << "\nOptions:";
+      for (const auto& [name, _] : parsers) {
+        std::cerr << " --" << name << "=...";
+      }
+      std::cerr << std::endl;
+      return false;
+    }
+    try {
+      parser->second(argument.substr(equals + 1));
+    } catch (const std::exception&) {
+      std::cerr << "Invalid value in " << argument << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+void WriteOptions(JsonWriter& json, const BenchmarkOptions& options,
+                  const ThreadPool& thread_pool) {
+  const CorpusOptions& corpus = options.corpus;
+  json.BeginObject("options");
+  json.Write("documents", corpus.document_count);
+  json.Write("vocabulary", corpus.vocabulary_size);
+  json.Write("zipf", corpus.zipf_exponent);
+  json.Write("min_words", corpus.min_document_words);
+  json.Write("max_words", corpus.max_document_words);
+  json.Write("stop_words", corpus.stop_word_count);
+  json.Write("stop_word_ratio", corpus.stop_word_ratio);
+  json.Write("queries", corpus.query_count);
+  json.Write("query_words", corpus.max_query_words);
+  json.Write("minus_word_ratio", corpus.minus_word_ratio);
+  json.Write("seed", corpus.seed);
+  json.Write("removals", options.removal_count);
+  json.Write("matches", options.match_count);
+  json.Write("concurrency", static_cast<double>(thread_pool.GetConcurrency()));
+  json.Write("hardware_concurrency", std::thread::hardware_concurrency());
+  json.EndObject();
+}
+
+// Ids of count documents, the same for every run with the seed.
+std::vector<int> PickDocumentIds(size_t document_count, size_t count,
+                                 uint32_t seed) {
+  std::vector<int> document_ids(document_count);
+  for (size_t i = 0; i < document_count; ++i) {
+    document_ids[i] = static_cast<int>(i);
+  }
+  std::mt19937 generator(seed);
+  count = std::min(count, document_count);
+  for (size_t i = 0; i < count; ++i) {
+    std::swap(document_ids[i],
+              document_ids[i + generator() % (document_count - i)]);
+  }
+  document_ids.resize(count);
+  return document_ids;
+}
+
+void RunBenchmarks(const BenchmarkOptions& options, JsonWriter& json) {
+  const auto thread_pool =
+      options.thread_count < 0
+          ? ThreadPool::GetDefault()
+          : std::make_shared<ThreadPool>(options.thread_count);
+
+  std::cerr << "Generating the corpus" << std::endl;
+  const Corpus corpus = GenerateCorpus(options.corpus);
+  const auto documents = corpus.GetDocuments();
+  const std::vector<std::string_view> queries(corpus.queries.begin(),
+                                              corpus.queries.end());
+
+  json.BeginObject();
+  WriteOptions(json, options, *thread_pool);
+  json.BeginObject("results");
+
+  // Two identical servers, one built document by document and one in a
+  // single parallel batch, so each removal benchmark gets its own.
+  std::cerr << "Indexing" << std::endl;
+  SearchServer server(corpus.stop_words);
+  server.SetThreadPool(thread_pool);
+  auto start_time = Clock::now();
+  for (const DocumentToAdd& document : documents) {
+    server.AddDocument(document.id, document.text, document.status,
+                       document.ratings);
+  }
+  WriteThroughput(json, "add_document", GetSeconds(start_time),
+                  documents.size(), corpus.GetByteCount());
+
+  SearchServer batch_server(corpus.stop_words);
+  batch_server.SetThreadPool(thread_pool);
+  start_time = Clock::now();
+  batch_server.AddDocuments(std::execution::par, documents);
+  WriteThroughput(json, "add_documents_par", GetSeconds(start_time),
+                  documents.size(), corpus.GetByteCount());
+
+  std::cerr << "Querying" << std::endl;
+  // Warms up the caches and the pool.
+  for (size_t i = 0; i < queries.size() / 10; ++i) {
+    server.FindTopDocuments(queries[i]);
+  }
+  server.ResetMetrics();
+  WriteLatencies(json, "find_top_documents_seq",
+                 MeasureLatencies(queries.size(), [&](size_t i) {
+                   server.FindTopDocuments(std::execution::seq, queries[i]);
+                 }));
+  WriteLatencies(json, "find_top_documents_par",
+                 MeasureLatencies(queries.size(), [&](size_t i) {
+                   server.FindTopDocuments(std::execution::par, queries[i]);
+                 }));
+  const SearchMetricsSnapshot metrics = server.GetMetricsSnapshot();
+  if (metrics.Get(QueryCounter::QUERIES) > 0) {
+    WriteMetrics(json, metrics);
+  }
+
+  const std::vector<int> match_ids =
+      PickDocumentIds(documents.size(), documents.size(),
+                      options.corpus.seed + 1);
+  const size_t match_count =
+      queries.empty() || documents.empty() ? 0 : options.match_count;
+  WriteLatencies(json, "match_document_seq",
+                 MeasureLatencies(match_count, [&](size_t i) {
+                   server.MatchDocument(std::execution::seq,
+                                        queries[i % queries.size()],
+                                        match_ids[i % match_ids.size()]);
+                 }));
+  WriteLatencies(json, "match_document_par",
+                 MeasureLatencies(match_count, [&](size_t i) {
+                   server.MatchDocument(std::execution::par,
+                                        queries[i % queries.size()],
+                                        match_ids[i % match_ids.size()]);
+                 }));
+
+  start_time = Clock::now();
+  const auto results = ProcessQueries(server, corpus.queries);
+  WriteThroughput(json, "process_queries", GetSeconds(start_time),
+                  results.size());
+
+  start_time = Clock::now();
+  for ([[maybe_unused]] const Document& document :
+       ProcessQueriesJoined(server, corpus.queries)) {
+  }
+  WriteThroughput(json, "process_queries_joined", GetSeconds(start_time),
+                  queries.size());
+
+  std::cerr << "Removing" << std::endl;
+  const std::vector<int> removed_ids = PickDocumentIds(
+      documents.size(), options.removal_count, options.corpus.seed + 2);
+  WriteLatencies(json, "remove_document_seq",
+                 MeasureLatencies(removed_ids.size(), [&](size_t i) {
+                   server.RemoveDocument(std::execution::seq, removed_ids[i]);
+                 }));
+  WriteLatencies(json, "remove_document_par",
+                 MeasureLatencies(removed_ids.size(), [&](size_t i) {
+                   batch_server.RemoveDocument(std::execution::par,
+                                               removed_ids[i]);
+                 }));
+
+  json.EndObject();
+  json.EndObject();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  BenchmarkOptions options;
+  if (!ParseOptions(argc, argv, options)) {
+    return EXIT_FAILURE;
+  }
+
+  if (options.output_path.empty()) {
+    JsonWriter json(std::cout);
+    RunBenchmarks(options, json);
+  } else {
+    std::ostringstream output;
+    JsonWriter json(output);
+    RunBenchmarks(options, json);
+    std::ofstream(options.output_path) << output.str();
+  }
+  return EXIT_SUCCESS;
+}
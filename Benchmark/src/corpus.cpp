@@ -0,0 +1,139 @@
+﻿#include "corpus.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+class CorpusRandom {
+ public:
+  explicit CorpusRandom(uint32_t seed) : generator_(seed) {}
+
+  // In [0, 1).
+  double NextDouble() { return generator_() / 4294967296.0; }
+  // In [0, bound).
+  int NextInt(int bound) { return static_cast<int>(generator_() % bound); }
+
+ private:
+  std::mt19937 generator_;
+};
+
+// Distinct lowercase words: bijective base 26 of index + 1.
+std::string MakeWord(int index) {
+  std::string word;
+  for (int rest = index + 1; rest > 0; rest = (rest - 1) / 26) {
+    word.push_back(static_cast<char>('a' + (rest - 1) % 26));
+  }
+  return word;
+}
+
+class ZipfDistribution {
+ public:
+  ZipfDistribution(int size, double exponent) : cumulative_(size) {
+    double sum = 0.0;
+    for (int k = 0; k < size; ++k) {
+      sum += 1.0 / std::pow(k + 1, exponent);
+      cumulative_[k] = sum;
+    }
+    for (double& value : cumulative_) {
+      value /= sum;
+    }
+  }
+
+  int operator()(CorpusRandom& random) const {
+    const auto helper = std::upper_bound(
+        cumulative_.begin(), cumulative_.end(), random.NextDouble());
+    return static_cast<int>(
+        std::min<ptrdiff_t>(helper - cumulative_.begin(),
+                            cumulative_.size() - 1));
+  }
+
+ private:
+  std::vector<double> cumulative_;
+};
+
+}  // namespace
+
+std::vector<DocumentToAdd> Corpus::GetDocuments() const {
+  std::vector<DocumentToAdd> documents;
+  documents.reserve(texts.size());
+  for (size_t i = 0; i < texts.size(); ++i) {
+    documents.push_back(
+        {static_cast<int>(i), texts[i], statuses[i], ratings[i]});
+  }
+  return documents;
+}
+
+size_t Corpus::GetByteCount() const {
+  size_t byte_count = 0;
+  for (const std::string& text : texts) {
+    byte_count += text.size();
+  }
+  return byte_count;
+}
+
+// Stop words take the first stop_word_count words, so they never collide
+// with the vocabulary.
+Corpus GenerateCorpus(const CorpusOptions& options) {
+  CorpusRandom random(options.seed);
+  const ZipfDistribution zipf(options.vocabulary_size, options.zipf_exponent);
+  const auto vocabulary_word = [&] {
+    return MakeWord(options.stop_word_count + zipf(random));
+  };
+
+  Corpus corpus;
+  for (int i = 0; i < options.stop_word_count; ++i) {
+    corpus.stop_words += (i == 0 ? "" : " ") + MakeWord(i);
+  }
+
+  const int length_range =
+      std::max(1, options.max_document_words - options.min_document_words + 1);
+  corpus.texts.reserve(options.document_count);
+  for (int i = 0; i < options.document_count; ++i) {
+    const int word_count =
+        options.min_document_words + random.NextInt(length_range);
+    std::string text;
+    for (int j = 0; j < word_count; ++j) {
+      if (j > 0) {
+        text.push_back(' ');
+      }
+      if (options.stop_word_count > 0 &&
+          random.NextDouble() < options.stop_word_ratio) {
+        text += MakeWord(random.NextInt(options.stop_word_count));
+      } else {
+        text += vocabulary_word();
+      }
+    }
+    corpus.texts.push_back(std::move(text));
+    // Mostly actual documents, as in a live index.
+    const int status = random.NextInt(10);
+    corpus.statuses.push_back(status < 7   ? DocumentStatus::ACTUAL
+                              : status < 8 ? DocumentStatus::IRRELEVANT
+                              : status < 9 ? DocumentStatus::BANNED
+                                           : DocumentStatus::REMOVED);
+    std::vector<int> ratings(1 + random.NextInt(5));
+    for (int& rating : ratings) {
+      rating = random.NextInt(11) - 5;
+    }
+    corpus.ratings.push_back(std::move(ratings));
+  }
+
+  corpus.queries.reserve(options.query_count);
+  for (int i = 0; i < options.query_count; ++i) {
+    const int word_count =
+        1 + random.NextInt(std::max(1, options.max_query_words));
+    std::string query;
+    for (int j = 0; j < word_count; ++j) {
+      if (j > 0) {
+        query.push_back(' ');
+      }
+      if (random.NextDouble() < options.minus_word_ratio) {
+        query.push_back('-');
+      }
+      query += vocabulary_word();
+    }
+    corpus.queries.push_back(std::move(query));
+  }
+  return corpus;
+}
@@ -0,0 +1,40 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "document.h"
+
+struct CorpusOptions {
+  int document_count = 100000;
+  int vocabulary_size = 50000;
+  // The k-th most frequent word has a probability proportional to
+  // 1 / k^zipf_exponent.
+  double zipf_exponent = 1.0;
+  int min_document_words = 10;
+  int max_document_words = 100;
+  int stop_word_count = 30;
+  // Share of the words of a document that are stop words.
+  double stop_word_ratio = 0.2;
+  int query_count = 10000;
+  int max_query_words = 4;
+  // Probability of a query word being a minus word.
+  double minus_word_ratio = 0.1;
+  uint32_t seed = 42;
+};
+
+// Synthetic documents and queries. Only std::mt19937 and integer arithmetic
+// are used, so a seed gives the same corpus with every standard library.
+struct Corpus {
+  std::string stop_words;
+  std::vector<std::string> texts;
+  std::vector<DocumentStatus> statuses;
+  std::vector<std::vector<int>> ratings;
+  std::vector<std::string> queries;
+
+  // Documents with ids 0, 1, ... in the order of texts.
+  std::vector<DocumentToAdd> GetDocuments() const;
+  size_t GetByteCount() const;
+};
+
+Corpus GenerateCorpus(const CorpusOptions& options);
@@ -0,0 +1,366 @@
+﻿#include "concurrent_search_server.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// Segments of WRITE_BUFFER_SIZE documents are in tier 0, the result of
+// merging MERGE_FACTOR of them in tier 1, and so on.
+size_t GetTier(int document_count) {
+  size_t tier = 0;
+  for (size_t size = ConcurrentSearchServer::WRITE_BUFFER_SIZE *
+                     ConcurrentSearchServer::MERGE_FACTOR;
+       static_cast<size_t>(document_count) >= size;
+       size *= ConcurrentSearchServer::MERGE_FACTOR) {
+    ++tier;
+  }
+  return tier;
+}
+
+}  // namespace
+
+bool ConcurrentSearchServer::Segment::Contains(int document_id) const {
+  return !(tombstones && tombstones->Contains(document_id)) &&
+         server->GetDocumentOrdinal(document_id).has_value();
+}
+
+int ConcurrentSearchServer::Segment::GetDocumentCount() const {
+  return server->GetDocumentCount() -
+         (tombstones ? static_cast<int>(tombstones->Size()) : 0);
+}
+
+ConcurrentSearchServer::~ConcurrentSearchServer() {
+  {
+    std::lock_guard guard(merge_mutex_);
+    stopping_ = true;
+  }
+  merge_condition_.notify_all();
+  merge_thread_.join();
+}
+
+void ConcurrentSearchServer::AddDocument(int document_id,
+                                         std::string_view document,
+                                         DocumentStatus status,
+                                         const std::vector<int>& ratings) {
+  std::lock_guard guard(write_mutex_);
+  if (IsLive(document_id)) {
+    throw std::invalid_argument("Invalid document ID"s);
+  }
+  write_buffer_->AddDocument(document_id, document, status, ratings);
+  if (write_buffer_->GetDocumentCount() >= WRITE_BUFFER_SIZE) {
+    SealWriteBuffer();
+  }
+}
+
+void ConcurrentSearchServer::AddDocuments(
+    const std::vector<DocumentToAdd>& documents) {
+  std::lock_guard guard(write_mutex_);
+  for (const DocumentToAdd& document : documents) {
+    if (IsLive(document.id)) {
+      throw std::invalid_argument("Invalid document ID"s);
+    }
+  }
+  write_buffer_->AddDocuments(std::execution::par, documents);
+  if (write_buffer_->GetDocumentCount() >= WRITE_BUFFER_SIZE) {
+    SealWriteBuffer();
+  }
+}
+
+void ConcurrentSearchServer::RemoveDocument(int document_id) {
+  std::lock_guard guard(write_mutex_);
+  if (write_buffer_->GetDocumentOrdinal(document_id).has_value()) {
+    write_buffer_->RemoveDocument(document_id);
+  } else {
+    pending_removals_.emplace(document_id, sealed_segments_.size());
+  }
+}
+
+// Segments without new removals are shared with the current generation;
+// the others get a copy of their tombstones with the new ones added. A
+// document added anew after a removal may be in several of the segments a
+// removal covers, so all of them are searched.
+void ConcurrentSearchServer::Commit() {
+  std::lock_guard guard(write_mutex_);
+  SealWriteBuffer();
+
+  std::vector<Segment> segments = GetGeneration()->segments;
+  const size_t published_count = segments.size();
+  segments.insert(segments.end(), sealed_segments_.begin(),
+                  sealed_segments_.end());
+  sealed_segments_.clear();
+
+  std::vector<std::vector<int>> removed_document_ids(segments.size());
+  for (const auto& [document_id, sealed_count] : pending_removals_) {
+    for (size_t i = 0; i < published_count + sealed_count; ++i) {
+      if (segments[i].Contains(document_id)) {
+        removed_document_ids[i].push_back(document_id);
+      }
+    }
+  }
+  pending_removals_.clear();
+
+  for (size_t i = 0; i < segments.size(); ++i) {
+    if (removed_document_ids[i].empty()) {
+      continue;
+    }
+    Segment& segment = segments[i];
+    auto tombstones =
+        segment.tombstones
+            ? std::make_shared<Tombstones>(*segment.tombstones)
+            : std::make_shared<Tombstones>(*segment.server);
+    for (const int document_id : removed_document_ids[i]) {
+      tombstones->Add(document_id,
+                      segment.server->GetWordFrequencies(document_id));
+    }
+    segment.tombstones = std::move(tombstones);
+  }
+  segments.erase(std::remove_if(segments.begin(), segments.end(),
+                                [](const Segment& segment) {
+                                  return segment.GetDocumentCount() == 0;
+                                }),
+                 segments.end());
+
+  Publish(std::move(segments));
+  RequestMerge();
+}
+
+void ConcurrentSearchServer::WaitForMerges() {
+  std::unique_lock lock(merge_mutex_);
+  merge_condition_.wait(lock,
+                        [this] { return !merge_requested_ && !merging_; });
+}
+
+std::vector<Document> ConcurrentSearchServer::FindTopDocuments(
+    std::string_view raw_query, DocumentStatus status,
+    size_t max_result_count) const {
+  return FindTopDocuments(
+      raw_query,
+      [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+      },
+      max_result_count);
+}
+
+std::vector<Document> ConcurrentSearchServer::FindTopDocuments(
+    std::string_view raw_query) const {
+  return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+std::tuple<std::vector<std::string>, DocumentStatus>
+ConcurrentSearchServer::MatchDocument(std::string_view raw_query,
+                                      int document_id) const {
+  const auto generation = GetGeneration();
+  for (const Segment& segment : generation->segments) {
+    if (segment.Contains(document_id)) {
+      const auto [words, status] =
+          segment.server->MatchDocument(raw_query, document_id);
+      return {std::vector<std::string>(words.begin(), words.end()), status};
+    }
+  }
+  throw std::invalid_argument("Non-existent document ID"s);
+}
+
+int ConcurrentSearchServer::GetDocumentCount() const {
+  int document_count = 0;
+  for (const Segment& segment : GetGeneration()->segments) {
+    document_count += segment.GetDocumentCount();
+  }
+  return document_count;
+}
+
+size_t ConcurrentSearchServer::GetSegmentCount() const {
+  return GetGeneration()->segments.size();
+}
+
+std::shared_ptr<const ConcurrentSearchServer::Generation>
+ConcurrentSearchServer::GetGeneration() const {
+  return generation_.load();
+}
+
+void ConcurrentSearchServer::Publish(std::vector<Segment> segments) {
+  auto next = std::make_shared<Generation>();
+  next->segments = std::move(segments);
+  for (const Segment& segment : next->segments) {
+    next->parts.push_back({segment.server.get(), segment.tombstones.get()});
+  }
+  generation_.store(std::move(next));
+}
+
+bool ConcurrentSearchServer::IsLive(int document_id) const {
+  if (write_buffer_->GetDocumentOrdinal(document_id).has_value()) {
+    return true;
+  }
+  // Only the latest removal matters: it covers the segments the earlier
+  // ones do.
+  const auto [first_removal, last_removal] =
+      pending_removals_.equal_range(document_id);
+  if (first_removal == last_removal) {
+    for (const Segment& segment : GetGeneration()->segments) {
+      if (segment.Contains(document_id)) {
+        return true;
+      }
+    }
+  }
+  size_t first_sealed = 0;
+  for (auto removal = first_removal; removal != last_removal; ++removal) {
+    first_sealed = std::max(first_sealed, removal->second);
+  }
+  for (size_t i = first_sealed; i < sealed_segments_.size(); ++i) {
+    if (sealed_segments_[i].Contains(document_id)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ConcurrentSearchServer::SealWriteBuffer() {
+  if (write_buffer_->GetDocumentCount() == 0) {
+    return;
+  }
+  sealed_segments_.push_back({std::move(write_buffer_), nullptr});
+  write_buffer_ = std::make_unique<SearchServer>(stop_words_);
+}
+
+void ConcurrentSearchServer::RequestMerge() {
+  {
+    std::lock_guard guard(merge_mutex_);
+    merge_requested_ = true;
+  }
+  merge_condition_.notify_all();
+}
+
+void ConcurrentSearchServer::RunMerges() {
+  std::unique_lock lock(merge_mutex_);
+  while (true) {
+    merge_condition_.wait(lock,
+                          [this] { return merge_requested_ || stopping_; });
+    if (stopping_) {
+      return;
+    }
+    merge_requested_ = false;
+    merging_ = true;
+    lock.unlock();
+    while (MergeOnce()) {
+      std::lock_guard guard(merge_mutex_);
+      if (stopping_) {
+        break;
+      }
+    }
+    lock.lock();
+    merging_ = false;
+    merge_condition_.notify_all();
+  }
+}
+
+// Only this thread takes segments out of a generation; commits meanwhile
+// append segments and add tombstones, including to the segments being
+// merged, which are carried over to the merged one.
+bool ConcurrentSearchServer::MergeOnce() {
+  const std::vector<Segment> inputs = PickMerge(*GetGeneration());
+  if (inputs.empty()) {
+    return false;
+  }
+  const auto merged = BuildMergedSegment(inputs);
+
+  std::lock_guard guard(write_mutex_);
+  std::vector<Segment> segments;
+  std::shared_ptr<Tombstones> tombstones;
+  bool merged_added = false;
+  for (const Segment& segment : GetGeneration()->segments) {
+    const auto input = std::find_if(
+        inputs.begin(), inputs.end(), [&segment](const Segment& input) {
+          return input.server == segment.server;
+        });
+    if (input == inputs.end()) {
+      segments.push_back(segment);
+      continue;
+    }
+    if (!merged) {
+      continue;
+    }
+    if (segment.tombstones && segment.tombstones != input->tombstones) {
+      for (const int document_id : segment.tombstones->GetDocumentIds()) {
+        if (input->tombstones && input->tombstones->Contains(document_id)) {
+          continue;
+        }
+        if (!tombstones) {
+          tombstones = std::make_shared<Tombstones>(*merged);
+        }
+        tombstones->Add(document_id, merged->GetWordFrequencies(document_id));
+      }
+    }
+    if (!merged_added) {
+      segments.push_back({merged, nullptr});
+      merged_added = true;
+    }
+  }
+  if (tombstones) {
+    for (Segment& segment : segments) {
+      if (segment.server == merged) {
+        segment.tombstones = std::move(tombstones);
+        break;
+      }
+    }
+  }
+  segments.erase(std::remove_if(segments.begin(), segments.end(),
+                                [](const Segment& segment) {
+                                  return segment.GetDocumentCount() == 0;
+                                }),
+                 segments.end());
+  Publish(std::move(segments));
+  return true;
+}
+
+// Picks MERGE_FACTOR segments of the lowest tier that has as many, or else
+// a segment with more removed documents than live ones.
+std::vector<ConcurrentSearchServer::Segment> ConcurrentSearchServer::PickMerge(
+    const Generation& generation) {
+  std::vector<std::vector<Segment>> tiers;
+  for (const Segment& segment : generation.segments) {
+    const size_t tier = GetTier(segment.GetDocumentCount());
+    if (tiers.size() <= tier) {
+      tiers.resize(tier + 1);
+    }
+    tiers[tier].push_back(segment);
+  }
+  for (auto& tier : tiers) {
+    if (tier.size() >= MERGE_FACTOR) {
+      std::partial_sort(tier.begin(), tier.begin() + MERGE_FACTOR, tier.end(),
+                        [](const Segment& lhs, const Segment& rhs) {
+                          return lhs.GetDocumentCount() <
+                                 rhs.GetDocumentCount();
+                        });
+      tier.resize(MERGE_FACTOR);
+      return tier;
+    }
+  }
+  for (const Segment& segment : generation.segments) {
+    if (segment.tombstones &&
+        static_cast<int>(segment.tombstones->Size()) >
+            segment.GetDocumentCount()) {
+      return {segment};
+    }
+  }
+  return {};
+}
+
+// Returns nullptr if no document is left.
+std::shared_ptr<const SearchServer> ConcurrentSearchServer::BuildMergedSegment(
+    const std::vector<Segment>& segments) const {
+  std::vector<DocumentToAdd> documents;
+  for (const Segment& segment : segments) {
+    for (const int document_id : *segment.server) {
+      if (!(segment.tombstones &&
+            segment.tombstones->Contains(document_id))) {
+        documents.push_back(*segment.server->GetDocument(document_id));
+      }
+    }
+  }
+  if (documents.empty()) {
+    return nullptr;
+  }
+  auto merged = std::make_shared<SearchServer>(stop_words_);
+  merged->AddDocuments(std::execution::par, documents);
+  return merged;
+}
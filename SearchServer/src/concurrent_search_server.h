@@ -0,0 +1,150 @@
+﻿#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "search_server.h"
+#include "sharded_search_server.h"
+#include "tombstones.h"
+
+// Search server that answers queries while documents are being added and
+// removed, organized like a log-structured merge tree. Documents live in
+// immutable segments, each an ordinary SearchServer, and a generation is the
+// list of segments at one moment.
+//
+// Writers stage their changes aside. Additions go to a write buffer that no
+// query sees; a full buffer is sealed into a segment, so the cost of an
+// addition does not grow with the index. Removals are only remembered. Commit
+// turns the staged removals into tombstones of the segments, appends the
+// sealed segments and publishes the next generation with an atomic pointer
+// swap. A query takes the current generation once and runs on it to the end,
+// so it never waits for a writer and sees the documents of exactly one
+// generation. Tombstones correct the document frequencies as well, so the
+// ranking is that of one server holding the live documents.
+//
+// A background thread keeps the number of segments logarithmic: whenever
+// MERGE_FACTOR segments of about the same size exist, it merges them into one
+// without their removed documents, and it rewrites segments whose documents
+// are mostly removed. Merging reads immutable segments and publishes the
+// result like a commit, so neither writers nor queries wait for it.
+class ConcurrentSearchServer {
+ public:
+  // Documents in the write buffer that make it a segment.
+  static constexpr int WRITE_BUFFER_SIZE = 4096;
+  static constexpr size_t MERGE_FACTOR = 8;
+
+  template <typename StringContainer>
+  explicit ConcurrentSearchServer(const StringContainer& stop_words);
+  explicit ConcurrentSearchServer(const std::string& stop_words_text)
+      : ConcurrentSearchServer(SplitIntoWords(stop_words_text)) {}
+  ConcurrentSearchServer(const ConcurrentSearchServer&) = delete;
+  ConcurrentSearchServer& operator=(const ConcurrentSearchServer&) = delete;
+  // Waits for the merge in progress, if any.
+  ~ConcurrentSearchServer();
+
+  // Writers may be called from several threads; they are serialized with
+  // each other but never with queries.
+  void AddDocument(int document_id, std::string_view document,
+                   DocumentStatus status, const std::vector<int>& ratings);
+  void AddDocuments(const std::vector<DocumentToAdd>& documents);
+  // Takes constant time; the document is looked for at the next commit.
+  void RemoveDocument(int document_id);
+  // Publishes everything staged since the last commit.
+  void Commit();
+  // Blocks until the background thread has no merge left to do.
+  void WaitForMerges();
+
+  template <typename DocumentPredicate>
+  std::vector<Document> FindTopDocuments(
+      std::string_view raw_query, DocumentPredicate document_predicate,
+      size_t max_result_count = SearchServer::MAX_RESULT_DOCUMENT_COUNT) const;
+  std::vector<Document> FindTopDocuments(
+      std::string_view raw_query, DocumentStatus status,
+      size_t max_result_count = SearchServer::MAX_RESULT_DOCUMENT_COUNT) const;
+  std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+  // The matched words are copied: the segment they come from may be freed
+  // by a commit or a merge as soon as the call returns.
+  std::tuple<std::vector<std::string>, DocumentStatus> MatchDocument(
+      std::string_view raw_query, int document_id) const;
+
+  // Both count the published documents only.
+  int GetDocumentCount() const;
+  size_t GetSegmentCount() const;
+
+ private:
+  struct Segment {
+    std::shared_ptr<const SearchServer> server;
+    // Removed documents of the segment; nullptr while there are none.
+    std::shared_ptr<const Tombstones> tombstones;
+
+    bool Contains(int document_id) const;
+    int GetDocumentCount() const;
+  };
+
+  struct Generation {
+    std::vector<Segment> segments;
+    std::vector<CollectionPart> parts;
+  };
+
+  const std::set<std::string, std::less<>> stop_words_;
+  std::atomic<std::shared_ptr<const Generation>> generation_;
+
+  std::mutex write_mutex_;
+  std::unique_ptr<SearchServer> write_buffer_;
+  // Full write buffers waiting for the next commit.
+  std::vector<Segment> sealed_segments_;
+  // Every removal since the last commit: the document id with the number of
+  // sealed segments at the time of removal. The document is removed from the
+  // published segments and from those sealed ones, later ones may hold it
+  // added anew. An id removed several times is in all of them.
+  std::unordered_multimap<int, size_t> pending_removals_;
+
+  std::mutex merge_mutex_;
+  std::condition_variable merge_condition_;
+  bool merge_requested_ = false;
+  bool merging_ = false;
+  bool stopping_ = false;
+  std::thread merge_thread_;
+
+  std::shared_ptr<const Generation> GetGeneration() const;
+  void Publish(std::vector<Segment> segments);
+  // Whether document_id is live in the documents staged so far.
+  bool IsLive(int document_id) const;
+  void SealWriteBuffer();
+
+  void RequestMerge();
+  void RunMerges();
+  // Merges one group of segments the policy picks. Returns false if there
+  // is none.
+  bool MergeOnce();
+  // The segments to merge next, empty if none.
+  static std::vector<Segment> PickMerge(const Generation& generation);
+  std::shared_ptr<const SearchServer> BuildMergedSegment(
+      const std::vector<Segment>& segments) const;
+};
+
+template <typename StringContainer>
+ConcurrentSearchServer::ConcurrentSearchServer(
+    const StringContainer& stop_words)
+    : stop_words_(MakeUniqueNonEmptyStrings(stop_words)),
+      generation_(std::make_shared<const Generation>()),
+      write_buffer_(std::make_unique<SearchServer>(stop_words_)),
+      merge_thread_([this] { RunMerges(); }) {}
+
+template <typename DocumentPredicate>
+std::vector<Document> ConcurrentSearchServer::FindTopDocuments(
+    std::string_view raw_query, DocumentPredicate document_predicate,
+    size_t max_result_count) const {
+  const auto generation = GetGeneration();
+  return FindTopDocumentsInCollection(generation->parts, raw_query,
+                                      document_predicate, max_result_count);
+}
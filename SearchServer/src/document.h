@@ -1,6 +1,8 @@
 #pragma once
 
 #include <iostream>
+#include <string_view>
+#include <vector>
 
 struct Document {
   int id = 0;
@@ -13,3 +15,10 @@ struct Document {
 };
 
 enum class DocumentStatus { ACTUAL, IRRELEVANT, BANNED, REMOVED };
+
+struct DocumentToAdd {
+  int id = 0;
+  std::string_view text;
+  DocumentStatus status = DocumentStatus::ACTUAL;
+  std::vector<int> ratings;
+};
@@ -0,0 +1,80 @@
+﻿#include "index_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+uint64_t UpdateIndexFileChecksum(uint64_t checksum, const char* data,
+                                 size_t size) {
+  const uint64_t FNV_PRIME = 1099511628211ull;
+  for (size_t i = 0; i < size; ++i) {
+    checksum ^= static_cast<unsigned char>(data[i]);
+    checksum *= FNV_PRIME;
+  }
+  return checksum;
+}
+
+IndexFileWriter::IndexFileWriter(const std::string& path)
+    : path_(path), out_(path, std::ios::binary | std::ios::trunc) {
+  if (!out_) {
+    throw std::runtime_error("Can not create index file "s + path);
+  }
+  out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+  size_ = sizeof(header_);
+}
+
+void IndexFileWriter::BeginSection(IndexFileSection section) {
+  static const char padding[8] = {};
+  const size_t padding_size = (8 - size_ % 8) % 8;
+  Append(padding, padding_size);
+  section_ = section;
+  section_offset_ = size_;
+}
+
+void IndexFileWriter::Append(const char* data, size_t size) {
+  out_.write(data, size);
+  checksum_ = UpdateIndexFileChecksum(checksum_, data, size);
+  size_ += size;
+}
+
+void IndexFileWriter::EndSection() {
+  header_.sections[static_cast<size_t>(section_)] = {section_offset_,
+                                                     size_ - section_offset_};
+  section_ = IndexFileSection::SECTION_COUNT;
+}
+
+void IndexFileWriter::WriteStrings(
+    IndexFileSection offsets_section, IndexFileSection chars_section,
+    const std::vector<std::string_view>& strings) {
+  std::vector<uint64_t> offsets;
+  offsets.reserve(strings.size() + 1);
+  offsets.push_back(0);
+  for (const std::string_view str : strings) {
+    offsets.push_back(offsets.back() + str.size());
+  }
+  WriteSection(offsets_section, offsets);
+
+  BeginSection(chars_section);
+  for (const std::string_view str : strings) {
+    Append(str.data(), str.size());
+  }
+  EndSection();
+}
+
+void IndexFileWriter::Finish(uint64_t document_count) {
+  std::memcpy(header_.magic, INDEX_FILE_MAGIC, sizeof(header_.magic));
+  header_.version = INDEX_FILE_VERSION;
+  header_.section_count = INDEX_FILE_SECTION_COUNT;
+  header_.file_size = size_;
+  header_.checksum = checksum_;
+  header_.document_count = document_count;
+
+  out_.seekp(0);
+  out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+  out_.close();
+  if (!out_) {
+    throw std::runtime_error("Can not write index file "s + path_);
+  }
+}
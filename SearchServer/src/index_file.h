@@ -0,0 +1,97 @@
+﻿#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Layout of the index segment written by SearchServer::SaveIndex and served
+// by MappedIndex. The file starts with IndexFileHeader, followed by the
+// sections, each at an 8-byte aligned offset. Numbers are stored in the
+// native byte order, so a file is only portable between machines of the same
+// endianness.
+//
+// Documents are numbered by their position in DOCUMENT_IDS, and postings
+// and DOCUMENT_DATA refer to them by that ordinal, so the file grows with
+// the number of documents, not with the largest id.
+constexpr char INDEX_FILE_MAGIC[8] = {'S', 'S', 'I', 'N', 'D', 'E', 'X', '\0'};
+constexpr uint32_t INDEX_FILE_VERSION = 1;
+
+enum class IndexFileSection : uint32_t {
+  STOP_WORD_OFFSETS,     // uint64_t[stop word count + 1]
+  STOP_WORD_CHARS,       // stop words in ascending order
+  TERM_OFFSETS,          // uint64_t[term count + 1]
+  TERM_CHARS,            // terms in ascending order
+  POSTING_OFFSETS,       // uint64_t[term count + 1]
+  POSTING_ORDINALS,      // int32_t[posting count], ascending per term
+  POSTING_TERM_FREQS,    // double[posting count]
+  DOCUMENT_DATA,         // IndexFileDocumentData[document count]
+  DOCUMENT_IDS,          // int32_t[document count] in ascending order
+  TEXT_OFFSETS,          // uint64_t[document count + 1]
+  TEXT_CHARS,            // document texts in DOCUMENT_IDS order
+  SECTION_COUNT
+};
+
+constexpr size_t INDEX_FILE_SECTION_COUNT =
+    static_cast<size_t>(IndexFileSection::SECTION_COUNT);
+
+struct IndexFileSectionRange {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct IndexFileDocumentData {
+  int32_t rating;
+  int32_t status;
+};
+
+struct IndexFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t section_count;
+  uint64_t file_size;
+  // FNV-1a over every byte after the header.
+  uint64_t checksum;
+  uint64_t document_count;
+  IndexFileSectionRange sections[INDEX_FILE_SECTION_COUNT];
+};
+
+uint64_t UpdateIndexFileChecksum(uint64_t checksum, const char* data,
+                                 size_t size);
+constexpr uint64_t INDEX_FILE_CHECKSUM_SEED = 14695981039346656037ull;
+
+// Streams sections to disk; the header is written last, once the sizes and
+// the checksum are known.
+class IndexFileWriter {
+ public:
+  explicit IndexFileWriter(const std::string& path);
+
+  void BeginSection(IndexFileSection section);
+  template <typename T>
+  void Append(const T* values, size_t count) {
+    Append(reinterpret_cast<const char*>(values), count * sizeof(T));
+  }
+  void Append(const char* data, size_t size);
+  void EndSection();
+
+  template <typename T>
+  void WriteSection(IndexFileSection section, const std::vector<T>& values) {
+    BeginSection(section);
+    Append(values.data(), values.size());
+    EndSection();
+  }
+  void WriteStrings(IndexFileSection offsets_section,
+                    IndexFileSection chars_section,
+                    const std::vector<std::string_view>& strings);
+
+  void Finish(uint64_t document_count);
+
+ private:
+  std::string path_;
+  std::ofstream out_;
+  IndexFileHeader header_ = {};
+  IndexFileSection section_ = IndexFileSection::SECTION_COUNT;
+  uint64_t section_offset_ = 0;
+  uint64_t size_ = 0;
+  uint64_t checksum_ = INDEX_FILE_CHECKSUM_SEED;
+};
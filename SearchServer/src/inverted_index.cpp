@@ -0,0 +1,718 @@
+﻿#include "inverted_index.h"
+
+#include <array>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define INVERTED_INDEX_SSE2
+#include <emmintrin.h>
+#endif
+#include <utility>
+
+namespace {
+
+// Blocks are split into LANE_COUNT interleaved lanes: lane l holds values l,
+// l + 4, l + 8 and so on, and word w of every lane is stored at
+// LANE_COUNT * w + l, so a single 16-byte load reads the same word of all
+// lanes and four values are unpacked at once.
+constexpr size_t LANE_COUNT = 4;
+constexpr size_t LANE_SIZE = PostingList::BLOCK_SIZE / LANE_COUNT;
+
+int GetBitWidth(uint32_t value) {
+  int bits = 0;
+  while (value != 0) {
+    ++bits;
+    value >>= 1;
+  }
+  return bits;
+}
+
+void AppendVarByte(uint32_t value, std::vector<uint8_t>& bytes) {
+  while (value >= 0x80) {
+    bytes.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  bytes.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t ReadVarByte(const uint8_t*& pos) {
+  uint32_t value = 0;
+  for (int shift = 0;; shift += 7) {
+    const uint8_t byte = *pos++;
+    value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+    if (byte < 0x80) {
+      return value;
+    }
+  }
+}
+
+// Appends BLOCK_SIZE values of the given width, LANE_COUNT * bits words.
+void PackLanes(const uint32_t* values, int bits, std::vector<uint32_t>& data) {
+  if (bits == 0) {
+    return;
+  }
+  const size_t first_word = data.size();
+  data.resize(first_word + LANE_COUNT * bits, 0);
+  for (size_t i = 0; i < PostingList::BLOCK_SIZE; ++i) {
+    const size_t bit = i / LANE_COUNT * bits;
+    uint32_t* lane_words = data.data() + first_word + i % LANE_COUNT;
+    lane_words[LANE_COUNT * (bit / 32)] |= values[i] << (bit % 32);
+    if (bit % 32 + bits > 32) {
+      lane_words[LANE_COUNT * (bit / 32 + 1)] |=
+          values[i] >> (32 - bit % 32);
+    }
+  }
+}
+
+// One unpacker per bit width, so the shifts and masks are constants.
+template <size_t BITS>
+void UnpackLanes(const uint32_t* data, uint32_t* values) {
+  if constexpr (BITS == 0) {
+    std::fill(values, values + PostingList::BLOCK_SIZE, 0u);
+  } else {
+    constexpr uint32_t MASK =
+        BITS == 32 ? ~uint32_t{0} : (uint32_t{1} << BITS) - 1;
+#ifdef INVERTED_INDEX_SSE2
+    const __m128i mask = _mm_set1_epi32(static_cast<int>(MASK));
+    for (size_t j = 0; j < LANE_SIZE; ++j) {
+      const size_t bit = j * BITS;
+      const auto* words =
+          reinterpret_cast<const __m128i*>(data + LANE_COUNT * (bit / 32));
+      __m128i lanes = _mm_srl_epi32(
+          _mm_loadu_si128(words),
+          _mm_cvtsi32_si128(static_cast<int>(bit % 32)));
+      if (bit % 32 + BITS > 32) {
+        lanes = _mm_or_si128(
+            lanes,
+            _mm_sll_epi32(_mm_loadu_si128(words + 1),
+                          _mm_cvtsi32_si128(static_cast<int>(
+                              32 - bit % 32))));
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(values + LANE_COUNT * j),
+                       _mm_and_si128(lanes, mask));
+    }
+#else
+    for (size_t i = 0; i < PostingList::BLOCK_SIZE; ++i) {
+      const size_t bit = i / LANE_COUNT * BITS;
+      const uint32_t* lane_words = data + i % LANE_COUNT;
+      uint32_t value = lane_words[LANE_COUNT * (bit / 32)] >> (bit % 32);
+      if (bit % 32 + BITS > 32) {
+        value |= lane_words[LANE_COUNT * (bit / 32 + 1)] << (32 - bit % 32);
+      }
+      values[i] = value & MASK;
+    }
+#endif
+  }
+}
+
+using Unpacker = void (*)(const uint32_t*, uint32_t*);
+
+template <size_t... BITS>
+constexpr std::array<Unpacker, sizeof...(BITS)> MakeUnpackers(
+    std::index_sequence<BITS...>) {
+  return {&UnpackLanes<BITS>...};
+}
+
+constexpr auto UNPACKERS = MakeUnpackers(std::make_index_sequence<33>());
+
+}  // namespace
+
+PostingList::Cursor::Cursor(const PostingList& postings)
+    : postings_(&postings) {
+  Load(0);
+}
+
+void PostingList::Cursor::Next() {
+  if (++pos_ == size_) {
+    Load(block_ + 1);
+  }
+}
+
+void PostingList::Cursor::SkipTo(int document_id) {
+  if (IsEnd() || DocumentId() >= document_id) {
+    return;
+  }
+  if (postings_->GetBlockLastDocumentId(block_) < document_id) {
+    // Targets are usually close to the current position, so gallop over the
+    // blocks first and binary search only the last step.
+    const size_t block_count = postings_->GetBlockCount();
+    size_t first = block_;
+    size_t step = 1;
+    while (first + step < block_count &&
+           postings_->GetBlockLastDocumentId(first + step) < document_id) {
+      first += step;
+      step *= 2;
+    }
+    size_t last = std::min(first + step, block_count);
+    ++first;
+    while (first < last) {
+      const size_t middle = first + (last - first) / 2;
+      if (postings_->GetBlockLastDocumentId(middle) < document_id) {
+        first = middle + 1;
+      } else {
+        last = middle;
+      }
+    }
+    Load(first);
+    if (IsEnd()) {
+      return;
+    }
+  }
+  pos_ = std::lower_bound(document_ids_ + pos_, document_ids_ + size_,
+                          document_id) -
+         document_ids_;
+}
+
+void PostingList::Cursor::ShallowSkipTo(int document_id) {
+  shallow_block_ = std::max(shallow_block_, block_);
+  while (shallow_block_ < postings_->GetBlockCount() &&
+         postings_->GetBlockLastDocumentId(shallow_block_) < document_id) {
+    ++shallow_block_;
+  }
+}
+
+double PostingList::Cursor::BlockMaxTermFreq() const {
+  return shallow_block_ < postings_->GetBlockCount()
+             ? postings_->GetBlockMaxTermFreq(shallow_block_)
+             : 0.0;
+}
+
+int PostingList::Cursor::BlockLastDocumentId() const {
+  return shallow_block_ < postings_->GetBlockCount()
+             ? postings_->GetBlockLastDocumentId(shallow_block_)
+             : std::numeric_limits<int>::max();
+}
+
+void PostingList::Cursor::Load(size_t block) {
+  block_ = block;
+  pos_ = 0;
+  size_ = block < postings_->GetBlockCount()
+              ? postings_->DecodeBlock(block, document_ids_, counts_)
+              : 0;
+}
+
+size_t PostingList::GetMemoryUsage() const {
+  size_t bytes = sizeof(PostingList) + blocks_.capacity() * sizeof(Block) +
+                 tail_.capacity();
+  for (const Block& block : blocks_) {
+    bytes += block.data.capacity() * sizeof(uint32_t);
+  }
+  return bytes;
+}
+
+bool PostingList::Contains(int document_id) const {
+  const size_t block = FindBlock(document_id);
+  if (block == GetBlockCount() ||
+      (block < blocks_.size() &&
+       blocks_[block].first_document_id > document_id)) {
+    return false;
+  }
+  int document_ids[BLOCK_SIZE];
+  uint32_t counts[BLOCK_SIZE];
+  const size_t size = DecodeBlock(block, document_ids, counts);
+  return std::binary_search(document_ids, document_ids + size, document_id);
+}
+
+void PostingList::Add(const Posting& posting) {
+  if (size_ == 0 ||
+      GetBlockLastDocumentId(GetBlockCount() - 1) < posting.document_id) {
+    AppendToTail(posting.document_id, posting.count);
+    tail_max_term_freq_ = std::max(tail_max_term_freq_, posting.term_freq);
+    max_term_freq_ = std::max(max_term_freq_, posting.term_freq);
+    if (tail_size_ == BLOCK_SIZE) {
+      SealTail();
+    }
+    ++size_;
+    OnSizeChanged();
+    return;
+  }
+
+  const size_t block = FindBlock(posting.document_id);
+  std::vector<int> document_ids(BLOCK_SIZE);
+  std::vector<uint32_t> counts(BLOCK_SIZE);
+  const size_t size = DecodeBlock(block, document_ids.data(), counts.data());
+  document_ids.resize(size);
+  counts.resize(size);
+
+  const auto helper = std::lower_bound(
+      document_ids.begin(), document_ids.end(), posting.document_id);
+  const auto pos = helper - document_ids.begin();
+  double max_term_freq = GetBlockMaxTermFreq(block);
+  if (*helper == posting.document_id) {
+    counts[pos] += posting.count;
+    max_term_freq += posting.term_freq;
+  } else {
+    document_ids.insert(helper, posting.document_id);
+    counts.insert(counts.begin() + pos, posting.count);
+    max_term_freq = std::max(max_term_freq, posting.term_freq);
+    ++size_;
+  }
+  ReplaceBlock(block, document_ids, counts, max_term_freq);
+  max_term_freq_ = std::max(max_term_freq_, max_term_freq);
+  OnSizeChanged();
+}
+
+void PostingList::Add(const std::vector<Posting>& postings) {
+  if (postings.empty()) {
+    return;
+  }
+  if (size_ == 0 || GetBlockLastDocumentId(GetBlockCount() - 1) <
+                        postings.front().document_id) {
+    for (const Posting& posting : postings) {
+      Add(posting);
+    }
+    return;
+  }
+
+  // Inserting the postings one by one would re-encode a block per posting,
+  // so everything from the first block they touch is decoded, merged with
+  // them and encoded again once. Decoded postings carry the maximum of their
+  // block as term frequency, which keeps the maxima upper bounds.
+  const size_t first_block = FindBlock(postings.front().document_id);
+  std::vector<Posting> old_postings;
+  DecodeBlocks(first_block, old_postings);
+  std::vector<Posting> merged;
+  merged.reserve(old_postings.size() + postings.size());
+  const auto append = [&merged](const Posting& posting) {
+    if (!merged.empty() && merged.back().document_id == posting.document_id) {
+      merged.back().count += posting.count;
+      merged.back().term_freq += posting.term_freq;
+    } else {
+      merged.push_back(posting);
+    }
+  };
+  auto old_helper = old_postings.begin();
+  for (const Posting& posting : postings) {
+    while (old_helper != old_postings.end() &&
+           old_helper->document_id <= posting.document_id) {
+      append(*old_helper++);
+    }
+    append(posting);
+  }
+  while (old_helper != old_postings.end()) {
+    append(*old_helper++);
+  }
+
+  size_ += merged.size() - old_postings.size();
+  for (const Posting& posting : merged) {
+    max_term_freq_ = std::max(max_term_freq_, posting.term_freq);
+  }
+  ReplaceBlocks(first_block, merged);
+  OnSizeChanged();
+}
+
+bool PostingList::Erase(int document_id) {
+  const size_t block = FindBlock(document_id);
+  if (block == GetBlockCount()) {
+    return false;
+  }
+  std::vector<int> document_ids(BLOCK_SIZE);
+  std::vector<uint32_t> counts(BLOCK_SIZE);
+  const size_t size = DecodeBlock(block, document_ids.data(), counts.data());
+  document_ids.resize(size);
+  counts.resize(size);
+
+  const auto helper =
+      std::lower_bound(document_ids.begin(), document_ids.end(), document_id);
+  if (helper == document_ids.end() || *helper != document_id) {
+    return false;
+  }
+  counts.erase(counts.begin() + (helper - document_ids.begin()));
+  document_ids.erase(helper);
+  ReplaceBlock(block, document_ids, counts, GetBlockMaxTermFreq(block));
+  MergeUnderfullBlocks(block, block + 1);
+  --size_;
+  OnSizeChanged();
+  return true;
+}
+
+size_t PostingList::Erase(const std::vector<int>& document_ids) {
+  std::vector<int> block_document_ids(BLOCK_SIZE);
+  std::vector<uint32_t> block_counts(BLOCK_SIZE);
+  size_t erased = 0;
+
+  auto helper = document_ids.begin();
+  size_t block = helper == document_ids.end() ? 0 : FindBlock(*helper);
+  const size_t first_block = block;
+  while (helper != document_ids.end() && block < GetBlockCount()) {
+    const int last_document_id = GetBlockLastDocumentId(block);
+    if (last_document_id < *helper) {
+      block = FindBlock(*helper);
+      continue;
+    }
+
+    block_document_ids.resize(BLOCK_SIZE);
+    block_counts.resize(BLOCK_SIZE);
+    const size_t size = DecodeBlock(block, block_document_ids.data(),
+                                    block_counts.data());
+    size_t kept = 0;
+    for (size_t pos = 0; pos < size; ++pos) {
+      while (helper != document_ids.end() &&
+             *helper < block_document_ids[pos]) {
+        ++helper;
+      }
+      if (helper != document_ids.end() &&
+          *helper == block_document_ids[pos]) {
+        continue;
+      }
+      block_document_ids[kept] = block_document_ids[pos];
+      block_counts[kept] = block_counts[pos];
+      ++kept;
+    }
+    while (helper != document_ids.end() && *helper <= last_document_id) {
+      ++helper;
+    }
+
+    if (kept == size) {
+      ++block;
+      continue;
+    }
+    erased += size - kept;
+    block_document_ids.resize(kept);
+    block_counts.resize(kept);
+    block += ReplaceBlock(block, block_document_ids, block_counts,
+                          GetBlockMaxTermFreq(block));
+  }
+
+  if (erased > 0) {
+    MergeUnderfullBlocks(first_block, block + 1);
+    size_ -= erased;
+    OnSizeChanged();
+  }
+  return erased;
+}
+
+size_t PostingList::FindBlock(int document_id) const {
+  const auto helper = std::lower_bound(
+      blocks_.begin(), blocks_.end(), document_id,
+      [](const Block& block, int document_id) {
+        return block.last_document_id < document_id;
+      });
+  const size_t block = helper - blocks_.begin();
+  if (block == blocks_.size() && tail_size_ != 0 &&
+      tail_last_document_id_ < document_id) {
+    return block + 1;
+  }
+  return block;
+}
+
+size_t PostingList::DecodeBlock(size_t block, int* document_ids,
+                                uint32_t* counts) const {
+  if (block == blocks_.size()) {
+    const uint8_t* pos = tail_.data();
+    int document_id = -1;
+    for (uint32_t i = 0; i < tail_size_; ++i) {
+      document_id += static_cast<int>(ReadVarByte(pos)) + 1;
+      document_ids[i] = document_id;
+      counts[i] = ReadVarByte(pos) + 1;
+    }
+    return tail_size_;
+  }
+
+  const Block& encoded = blocks_[block];
+  uint32_t gaps[BLOCK_SIZE];
+  UNPACKERS[encoded.gap_bits](encoded.data.data(), gaps);
+  UNPACKERS[encoded.count_bits](
+      encoded.data.data() + LANE_COUNT * encoded.gap_bits, counts);
+
+  // Gaps are taken between postings LANE_COUNT apart, so restoring the ids
+  // of four postings is a single vector addition.
+#ifdef INVERTED_INDEX_SSE2
+  __m128i lanes = _mm_set1_epi32(encoded.first_document_id);
+  const __m128i one = _mm_set1_epi32(1);
+  for (size_t i = 0; i < BLOCK_SIZE; i += LANE_COUNT) {
+    lanes = _mm_add_epi32(
+        lanes, _mm_loadu_si128(reinterpret_cast<const __m128i*>(gaps + i)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(document_ids + i), lanes);
+    auto* count_lanes = reinterpret_cast<__m128i*>(counts + i);
+    _mm_storeu_si128(count_lanes,
+                     _mm_add_epi32(_mm_loadu_si128(count_lanes), one));
+  }
+#else
+  for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+    document_ids[i] =
+        (i < LANE_COUNT ? encoded.first_document_id
+                        : document_ids[i - LANE_COUNT]) +
+        static_cast<int>(gaps[i]);
+    ++counts[i];
+  }
+#endif
+  return encoded.size;
+}
+
+// Blocks are always encoded with BLOCK_SIZE values; shorter ones are padded
+// by repeating the last posting. Counts are stored minus one, so single
+// occurrences need no bits at all.
+PostingList::Block PostingList::EncodeBlock(const int* document_ids,
+                                            const uint32_t* counts,
+                                            size_t size,
+                                            double max_term_freq) {
+  Block block;
+  block.first_document_id = document_ids[0];
+  block.last_document_id = document_ids[size - 1];
+  block.size = static_cast<uint32_t>(size);
+  block.max_term_freq = max_term_freq;
+
+  uint32_t gaps[BLOCK_SIZE];
+  uint32_t stored_counts[BLOCK_SIZE];
+  uint32_t gap_bits_mask = 0;
+  uint32_t count_bits_mask = 0;
+  for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+    const int document_id = document_ids[std::min(i, size - 1)];
+    const int previous_document_id =
+        i < LANE_COUNT ? block.first_document_id
+                       : document_ids[std::min(i - LANE_COUNT, size - 1)];
+    gaps[i] = static_cast<uint32_t>(document_id - previous_document_id);
+    stored_counts[i] = i < size ? counts[i] - 1 : 0;
+    gap_bits_mask |= gaps[i];
+    count_bits_mask |= stored_counts[i];
+  }
+  block.gap_bits = static_cast<uint8_t>(GetBitWidth(gap_bits_mask));
+  block.count_bits = static_cast<uint8_t>(GetBitWidth(count_bits_mask));
+
+  block.data.reserve(LANE_COUNT * (block.gap_bits + block.count_bits));
+  PackLanes(gaps, block.gap_bits, block.data);
+  PackLanes(stored_counts, block.count_bits, block.data);
+  return block;
+}
+
+size_t PostingList::ReplaceBlock(size_t block,
+                                 const std::vector<int>& document_ids,
+                                 const std::vector<uint32_t>& counts,
+                                 double max_term_freq) {
+  if (block == blocks_.size()) {
+    tail_.clear();
+    tail_size_ = 0;
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+      AppendToTail(document_ids[i], counts[i]);
+    }
+    tail_max_term_freq_ = document_ids.empty() ? 0.0 : max_term_freq;
+    if (tail_size_ == BLOCK_SIZE) {
+      SealTail();
+    }
+    return document_ids.empty() ? 0 : 1;
+  }
+
+  if (document_ids.empty()) {
+    blocks_.erase(blocks_.begin() + block);
+    return 0;
+  }
+  if (document_ids.size() <= BLOCK_SIZE) {
+    blocks_[block] = EncodeBlock(document_ids.data(), counts.data(),
+                                 document_ids.size(), max_term_freq);
+    return 1;
+  }
+  const size_t half = document_ids.size() / 2;
+  blocks_[block] =
+      EncodeBlock(document_ids.data(), counts.data(), half, max_term_freq);
+  blocks_.insert(blocks_.begin() + block + 1,
+                 EncodeBlock(document_ids.data() + half, counts.data() + half,
+                             document_ids.size() - half, max_term_freq));
+  return 2;
+}
+
+void PostingList::DecodeBlocks(size_t first_block,
+                               std::vector<Posting>& postings) const {
+  int document_ids[BLOCK_SIZE];
+  uint32_t counts[BLOCK_SIZE];
+  for (size_t block = first_block; block < GetBlockCount(); ++block) {
+    const size_t size = DecodeBlock(block, document_ids, counts);
+    const double max_term_freq = GetBlockMaxTermFreq(block);
+    for (size_t i = 0; i < size; ++i) {
+      postings.push_back({document_ids[i], counts[i], max_term_freq});
+    }
+  }
+}
+
+void PostingList::ReplaceBlocks(size_t first_block,
+                                const std::vector<Posting>& postings) {
+  blocks_.erase(blocks_.begin() + first_block, blocks_.end());
+  tail_.clear();
+  tail_size_ = 0;
+  tail_max_term_freq_ = 0.0;
+  int document_ids[BLOCK_SIZE];
+  uint32_t counts[BLOCK_SIZE];
+  size_t pos = 0;
+  for (; pos + BLOCK_SIZE <= postings.size(); pos += BLOCK_SIZE) {
+    double max_term_freq = 0.0;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+      document_ids[i] = postings[pos + i].document_id;
+      counts[i] = postings[pos + i].count;
+      max_term_freq = std::max(max_term_freq, postings[pos + i].term_freq);
+    }
+    blocks_.push_back(
+        EncodeBlock(document_ids, counts, BLOCK_SIZE, max_term_freq));
+  }
+  for (; pos < postings.size(); ++pos) {
+    AppendToTail(postings[pos].document_id, postings[pos].count);
+    tail_max_term_freq_ =
+        std::max(tail_max_term_freq_, postings[pos].term_freq);
+  }
+}
+
+void PostingList::MergeUnderfullBlocks(size_t first_block,
+                                       size_t last_block) {
+  std::vector<int> document_ids(2 * BLOCK_SIZE);
+  std::vector<uint32_t> counts(2 * BLOCK_SIZE);
+  size_t block = first_block;
+  while (block < std::min(last_block, blocks_.size())) {
+    if (blocks_[block].size >= BLOCK_SIZE / 2 || GetBlockCount() == 1) {
+      ++block;
+      continue;
+    }
+    // A block merges with the next one, the last block with the previous
+    // one, and only a single block with the tail.
+    const size_t left =
+        block + 1 == blocks_.size() && block > 0 ? block - 1 : block;
+    const size_t right = left + 1;
+    if (right == blocks_.size()) {
+      std::vector<Posting> postings;
+      DecodeBlocks(left, postings);
+      ReplaceBlocks(left, postings);
+      return;
+    }
+
+    document_ids.resize(2 * BLOCK_SIZE);
+    counts.resize(2 * BLOCK_SIZE);
+    size_t size = DecodeBlock(left, document_ids.data(), counts.data());
+    size += DecodeBlock(right, document_ids.data() + size,
+                        counts.data() + size);
+    document_ids.resize(size);
+    counts.resize(size);
+    const double max_term_freq =
+        std::max(blocks_[left].max_term_freq, blocks_[right].max_term_freq);
+    blocks_.erase(blocks_.begin() + right);
+    // More than BLOCK_SIZE postings are split into two halves, each at least
+    // half full.
+    if (ReplaceBlock(left, document_ids, counts, max_term_freq) == 1 &&
+        last_block > right) {
+      --last_block;
+    }
+    block = left;
+  }
+}
+
+void PostingList::AppendToTail(int document_id, uint32_t count) {
+  const int previous_document_id =
+      tail_size_ == 0 ? -1 : tail_last_document_id_;
+  AppendVarByte(static_cast<uint32_t>(document_id - previous_document_id - 1),
+                tail_);
+  AppendVarByte(count - 1, tail_);
+  tail_last_document_id_ = document_id;
+  ++tail_size_;
+}
+
+void PostingList::SealTail() {
+  int document_ids[BLOCK_SIZE];
+  uint32_t counts[BLOCK_SIZE];
+  const size_t size = DecodeBlock(blocks_.size(), document_ids, counts);
+  blocks_.push_back(
+      EncodeBlock(document_ids, counts, size, tail_max_term_freq_));
+  // Most lists never fill another block, so the buffer is not kept around.
+  std::vector<uint8_t>().swap(tail_);
+  tail_size_ = 0;
+  tail_max_term_freq_ = 0.0;
+}
+
+void PostingList::OnSizeChanged() {
+  if (size_ == 0) {
+    max_term_freq_ = 0.0;
+  }
+  log_document_freq_ =
+      size_ == 0 ? 0.0 : std::log(static_cast<double>(size_));
+}
+
+InvertedIndex::TermId InvertedIndex::FindTerm(std::string_view word) const {
+  const auto helper = term_ids_.find(word);
+  return helper == term_ids_.end() ? NO_TERM : helper->second;
+}
+
+InvertedIndex::TermId InvertedIndex::AddPosting(
+    std::string_view word, const PostingList::Posting& posting) {
+  const TermId term_id = InternTerm(word);
+  postings_[term_id].Add(posting);
+  return term_id;
+}
+
+InvertedIndex::TermId InvertedIndex::InternTerm(std::string_view word) {
+  const auto helper = term_ids_.find(word);
+  if (helper != term_ids_.end()) {
+    return helper->second;
+  }
+  TermId term_id;
+  if (free_term_ids_.empty()) {
+    term_id = static_cast<TermId>(postings_.size());
+    terms_.emplace_back(word);
+    postings_.emplace_back();
+  } else {
+    term_id = free_term_ids_.back();
+    free_term_ids_.pop_back();
+    terms_[term_id] = word;
+  }
+  term_ids_.emplace(terms_[term_id], term_id);
+  return term_id;
+}
+
+std::vector<InvertedIndex::TermId> InvertedIndex::GetTermIds() const {
+  std::vector<TermId> term_ids;
+  term_ids.reserve(term_ids_.size());
+  for (const auto& [_, term_id] : term_ids_) {
+    term_ids.push_back(term_id);
+  }
+  return term_ids;
+}
+
+void InvertedIndex::ErasePosting(TermId term_id, int document_id) {
+  postings_[term_id].Erase(document_id);
+  DropTermIfUnused(term_id);
+}
+
+// Every removal touches its own posting list; only the dictionary update
+// has to be sequential. Tasks get about the same number of postings to
+// erase, however they are spread over the terms.
+void InvertedIndex::ErasePostings(ThreadPool* thread_pool,
+                                  const std::vector<Removal>& removals) {
+  const size_t MIN_POSTINGS_PER_TASK = 1024;
+
+  size_t posting_count = 0;
+  for (const auto& [_, document_ids] : removals) {
+    posting_count += document_ids.size();
+  }
+  const size_t grain_size =
+      removals.empty() ? 1
+                       : MIN_POSTINGS_PER_TASK * removals.size() /
+                             std::max<size_t>(posting_count, 1);
+  ParallelFor(thread_pool, removals.size(), grain_size, [&](size_t i) {
+    postings_[removals[i].first].Erase(removals[i].second);
+  });
+  for (const auto& [term_id, _] : removals) {
+    DropTermIfUnused(term_id);
+  }
+}
+
+void InvertedIndex::DropTermIfUnused(TermId term_id) {
+  if (!postings_[term_id].Empty() || terms_[term_id].empty()) {
+    return;
+  }
+  term_ids_.erase(terms_[term_id]);
+  postings_[term_id] = PostingList();
+  terms_[term_id] = std::string();
+  free_term_ids_.push_back(term_id);
+}
+
+size_t InvertedIndex::GetPostingCount() const {
+  size_t posting_count = 0;
+  for (const PostingList& postings : postings_) {
+    posting_count += postings.Size();
+  }
+  return posting_count;
+}
+
+size_t InvertedIndex::GetPostingMemoryUsage() const {
+  size_t bytes = 0;
+  for (const PostingList& postings : postings_) {
+    bytes += postings.GetMemoryUsage();
+  }
+  return bytes;
+}
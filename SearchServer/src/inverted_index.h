@@ -0,0 +1,245 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.h"
+
+// Postings of one term in ascending document id order. Full blocks of
+// BLOCK_SIZE postings are compressed: document ids as bit-packed gaps and
+// term counts as bit-packed integers, both with the smallest bit width the
+// block needs. Every block keeps its first and last document id and the
+// largest term frequency in it, so scans can skip whole blocks and dynamic
+// pruning can bound their scores. The newest postings wait in a
+// variable-byte encoded tail until a block is full, which keeps appending
+// cheap and short lists small. Erasing keeps every block but the tail at
+// least half full by merging it with a neighbor.
+//
+// Only counts are stored; a term frequency is the count times the inverse
+// word count of the document, which the caller keeps. Block maxima are upper
+// bounds: erasing postings does not lower them.
+class PostingList {
+ public:
+  static constexpr size_t BLOCK_SIZE = 128;
+
+  struct Posting {
+    int document_id;
+    uint32_t count;
+    // Used for the block maxima only.
+    double term_freq;
+  };
+
+  // Forward-only position in a posting list for document-at-a-time
+  // traversal. Decodes one block at a time.
+  class Cursor {
+   public:
+    explicit Cursor(const PostingList& postings);
+
+    bool IsEnd() const { return block_ == postings_->GetBlockCount(); }
+    int DocumentId() const { return document_ids_[pos_]; }
+    uint32_t Count() const { return counts_[pos_]; }
+
+    void Next();
+    // Moves to the first posting whose document id is not less than
+    // document_id.
+    void SkipTo(int document_id);
+
+    // Finds, without moving the cursor, the block that would hold
+    // document_id and reports its largest term frequency and last document
+    // id. Past the last block both are "nothing": zero and the largest int.
+    void ShallowSkipTo(int document_id);
+    double BlockMaxTermFreq() const;
+    int BlockLastDocumentId() const;
+
+   private:
+    const PostingList* postings_;
+    size_t block_ = 0;
+    size_t pos_ = 0;
+    size_t size_ = 0;
+    size_t shallow_block_ = 0;
+    int document_ids_[BLOCK_SIZE];
+    uint32_t counts_[BLOCK_SIZE];
+
+    void Load(size_t block);
+  };
+
+  size_t Size() const { return size_; }
+  bool Empty() const { return size_ == 0; }
+
+  double GetMaxTermFreq() const { return max_term_freq_; }
+  // log(Size()), kept up to date by every change of the list.
+  double GetLogDocumentFreq() const { return log_document_freq_; }
+  // Bytes held by the list, including its own size.
+  size_t GetMemoryUsage() const;
+
+  bool Contains(int document_id) const;
+
+  // Calls handler(document_id, count) for every posting in order.
+  template <typename Handler>
+  void ForEach(Handler handler) const;
+  // The same for the postings with first_document_id <= document_id <
+  // last_document_id; blocks outside the range are not decoded.
+  template <typename Handler>
+  void ForEachInRange(int first_document_id, int last_document_id,
+                      Handler handler) const;
+
+  // Adding a posting for a document the list already holds adds the counts.
+  void Add(const Posting& posting);
+  // Postings must be sorted by document id. Postings that do not go past the
+  // end of the list are merged into it in one pass.
+  void Add(const std::vector<Posting>& postings);
+  bool Erase(int document_id);
+  // Erases all of the ascending document_ids and returns how many postings
+  // were removed.
+  size_t Erase(const std::vector<int>& document_ids);
+
+ private:
+  struct Block {
+    int first_document_id = 0;
+    int last_document_id = 0;
+    uint32_t size = 0;
+    uint8_t gap_bits = 0;
+    uint8_t count_bits = 0;
+    double max_term_freq = 0.0;
+    std::vector<uint32_t> data;
+  };
+
+  // Compressed blocks followed by the tail, which counts as the last block
+  // when it is not empty. The tail holds for every posting the gap to the
+  // previous document id minus one and the count minus one.
+  std::vector<Block> blocks_;
+  std::vector<uint8_t> tail_;
+  uint32_t tail_size_ = 0;
+  int tail_last_document_id_ = 0;
+  double tail_max_term_freq_ = 0.0;
+
+  size_t size_ = 0;
+  double max_term_freq_ = 0.0;
+  double log_document_freq_ = 0.0;
+
+  size_t GetBlockCount() const {
+    return blocks_.size() + (tail_size_ == 0 ? 0 : 1);
+  }
+  int GetBlockLastDocumentId(size_t block) const {
+    return block < blocks_.size() ? blocks_[block].last_document_id
+                                  : tail_last_document_id_;
+  }
+  double GetBlockMaxTermFreq(size_t block) const {
+    return block < blocks_.size() ? blocks_[block].max_term_freq
+                                  : tail_max_term_freq_;
+  }
+  // First block whose last document id is not less than document_id, or
+  // GetBlockCount().
+  size_t FindBlock(int document_id) const;
+  // Writes the postings of block to the arrays and returns their number.
+  size_t DecodeBlock(size_t block, int* document_ids, uint32_t* counts) const;
+
+  static Block EncodeBlock(const int* document_ids, const uint32_t* counts,
+                           size_t size, double max_term_freq);
+  // Replaces block with the given postings, splitting it if they do not fit
+  // and dropping it if there are none. Returns the number of blocks it was
+  // replaced by.
+  size_t ReplaceBlock(size_t block, const std::vector<int>& document_ids,
+                      const std::vector<uint32_t>& counts,
+                      double max_term_freq);
+  // Appends the postings of first_block and all blocks after it, with the
+  // block maximum as term frequency.
+  void DecodeBlocks(size_t first_block, std::vector<Posting>& postings) const;
+  // Replaces first_block and all blocks after it with the postings: full
+  // blocks and the rest in the tail.
+  void ReplaceBlocks(size_t first_block, const std::vector<Posting>& postings);
+  // Merges the blocks in [first_block, last_block) that erasing left less
+  // than half full with a neighbor. The tail is never merged on its own.
+  void MergeUnderfullBlocks(size_t first_block, size_t last_block);
+  void AppendToTail(int document_id, uint32_t count);
+  void SealTail();
+  void OnSizeChanged();
+};
+
+template <typename Handler>
+void PostingList::ForEach(Handler handler) const {
+  int document_ids[BLOCK_SIZE];
+  uint32_t counts[BLOCK_SIZE];
+  for (size_t block = 0; block < GetBlockCount(); ++block) {
+    const size_t size = DecodeBlock(block, document_ids, counts);
+    for (size_t i = 0; i < size; ++i) {
+      handler(document_ids[i], counts[i]);
+    }
+  }
+}
+
+template <typename Handler>
+void PostingList::ForEachInRange(int first_document_id, int last_document_id,
+                                 Handler handler) const {
+  int document_ids[BLOCK_SIZE];
+  uint32_t counts[BLOCK_SIZE];
+  for (size_t block = FindBlock(first_document_id); block < GetBlockCount();
+       ++block) {
+    const size_t size = DecodeBlock(block, document_ids, counts);
+    if (document_ids[0] >= last_document_id) {
+      break;
+    }
+    for (size_t i = 0; i < size; ++i) {
+      if (document_ids[i] >= first_document_id &&
+          document_ids[i] < last_document_id) {
+        handler(document_ids[i], counts[i]);
+      }
+    }
+  }
+}
+
+// Term dictionary plus posting lists. Every distinct word is copied once into
+// the dictionary and gets a dense term id, so the index never refers to the
+// text of the documents and everything past the dictionary works with ids.
+// Ids of terms that lose their last posting are reused.
+class InvertedIndex {
+ public:
+  using TermId = uint32_t;
+  static constexpr TermId NO_TERM = std::numeric_limits<TermId>::max();
+
+  InvertedIndex() = default;
+  InvertedIndex(const InvertedIndex&) = delete;
+  InvertedIndex& operator=(const InvertedIndex&) = delete;
+
+  // Ascending ids of the documents to erase from the postings of a term.
+  using Removal = std::pair<TermId, std::vector<int>>;
+
+  // Returns NO_TERM for unknown words.
+  TermId FindTerm(std::string_view word) const;
+  std::string_view GetTerm(TermId term_id) const { return terms_[term_id]; }
+  const PostingList& GetPostings(TermId term_id) const {
+    return postings_[term_id];
+  }
+  // References stay valid until the next term is added.
+  PostingList& GetPostings(TermId term_id) { return postings_[term_id]; }
+
+  TermId AddPosting(std::string_view word, const PostingList::Posting& posting);
+  // Returns the id of word, adding it to the dictionary if needed.
+  TermId InternTerm(std::string_view word);
+
+  // Terms left without postings are dropped from the dictionary.
+  void ErasePosting(TermId term_id, int document_id);
+  // Runs on thread_pool unless it is nullptr.
+  void ErasePostings(ThreadPool* thread_pool,
+                     const std::vector<Removal>& removals);
+
+  size_t GetTermCount() const { return term_ids_.size(); }
+  size_t GetPostingCount() const;
+  // Bytes held by the posting lists.
+  size_t GetPostingMemoryUsage() const;
+  std::vector<TermId> GetTermIds() const;
+
+ private:
+  std::unordered_map<std::string_view, TermId> term_ids_;
+  std::deque<std::string> terms_;
+  std::vector<PostingList> postings_;
+  std::vector<TermId> free_term_ids_;
+
+  void DropTermIfUnused(TermId term_id);
+};
@@ -0,0 +1,254 @@
+﻿#include "mapped_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std::string_literals;
+
+size_t MappedIndex::StringTable::Find(std::string_view str) const {
+  size_t first = 0;
+  size_t last = size_;
+  while (first < last) {
+    const size_t middle = first + (last - first) / 2;
+    if ((*this)[middle] < str) {
+      first = middle + 1;
+    } else {
+      last = middle;
+    }
+  }
+  return (first < size_ && (*this)[first] == str) ? first : size_;
+}
+
+MappedIndex::MappedIndex(const std::string& path) : path_(path) {
+  Map();
+  try {
+    Validate();
+  } catch (...) {
+    Unmap();
+    throw;
+  }
+}
+
+MappedIndex::~MappedIndex() { Unmap(); }
+
+#ifdef _WIN32
+void MappedIndex::Map() {
+  file_ = CreateFileA(path_.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    file_ = nullptr;
+    throw std::runtime_error("Can not open index file "s + path_);
+  }
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file_, &file_size) || file_size.QuadPart == 0) {
+    Unmap();
+    ThrowCorrupted();
+  }
+  size_ = static_cast<size_t>(file_size.QuadPart);
+  mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping_ != nullptr) {
+    data_ = static_cast<const char*>(
+        MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  }
+  if (data_ == nullptr) {
+    Unmap();
+    throw std::runtime_error("Can not map index file "s + path_);
+  }
+}
+
+void MappedIndex::Unmap() {
+  if (data_ != nullptr) {
+    UnmapViewOfFile(data_);
+  }
+  if (mapping_ != nullptr) {
+    CloseHandle(mapping_);
+  }
+  if (file_ != nullptr) {
+    CloseHandle(file_);
+  }
+  data_ = nullptr;
+  mapping_ = nullptr;
+  file_ = nullptr;
+}
+#else
+void MappedIndex::Map() {
+  const int fd = open(path_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Can not open index file "s + path_);
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+    close(fd);
+    ThrowCorrupted();
+  }
+  size_ = static_cast<size_t>(file_stat.st_size);
+  void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    throw std::runtime_error("Can not map index file "s + path_);
+  }
+  data_ = static_cast<const char*>(data);
+}
+
+void MappedIndex::Unmap() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+  data_ = nullptr;
+}
+#endif
+
+template <typename T>
+const T* MappedIndex::GetSection(IndexFileSection section,
+                                 size_t& count) const {
+  const IndexFileSectionRange& range =
+      header_->sections[static_cast<size_t>(section)];
+  count = range.size / sizeof(T);
+  return reinterpret_cast<const T*>(data_ + range.offset);
+}
+
+// Checks the header and that the sections fit together without reading
+// them, apart from the offset tables, so opening does not get slower as the
+// index grows. Postings are checked as queries read them.
+void MappedIndex::Validate() {
+  if (size_ < sizeof(IndexFileHeader)) {
+    ThrowCorrupted();
+  }
+  header_ = reinterpret_cast<const IndexFileHeader*>(data_);
+  if (std::memcmp(header_->magic, INDEX_FILE_MAGIC, sizeof(INDEX_FILE_MAGIC)) !=
+      0) {
+    ThrowCorrupted();
+  }
+  if (header_->version != INDEX_FILE_VERSION) {
+    throw std::runtime_error("Index file "s + path_ +
+                             " has unsupported version "s +
+                             std::to_string(header_->version));
+  }
+  if (header_->section_count != INDEX_FILE_SECTION_COUNT ||
+      header_->file_size != size_) {
+    ThrowCorrupted();
+  }
+  for (const IndexFileSectionRange& range : header_->sections) {
+    if (range.offset % 8 != 0 || range.offset < sizeof(IndexFileHeader) ||
+        range.offset > size_ || range.size > size_ - range.offset) {
+      ThrowCorrupted();
+    }
+  }
+
+  const auto load_strings = [&](IndexFileSection offsets_section,
+                                IndexFileSection chars_section) {
+    size_t offset_count = 0;
+    size_t char_count = 0;
+    const auto* offsets = GetSection<uint64_t>(offsets_section, offset_count);
+    const auto* chars = GetSection<char>(chars_section, char_count);
+    if (offset_count == 0 || offsets[offset_count - 1] != char_count) {
+      ThrowCorrupted();
+    }
+    return StringTable(this, offsets, chars, offset_count - 1);
+  };
+  stop_words_ = load_strings(IndexFileSection::STOP_WORD_OFFSETS,
+                             IndexFileSection::STOP_WORD_CHARS);
+  terms_ = load_strings(IndexFileSection::TERM_OFFSETS,
+                        IndexFileSection::TERM_CHARS);
+  texts_ = load_strings(IndexFileSection::TEXT_OFFSETS,
+                        IndexFileSection::TEXT_CHARS);
+
+  size_t posting_offset_count = 0;
+  size_t posting_count = 0;
+  size_t term_freq_count = 0;
+  posting_offsets_ = GetSection<uint64_t>(IndexFileSection::POSTING_OFFSETS,
+                                          posting_offset_count);
+  posting_ordinals_ =
+      GetSection<int32_t>(IndexFileSection::POSTING_ORDINALS, posting_count);
+  posting_term_freqs_ = GetSection<double>(IndexFileSection::POSTING_TERM_FREQS,
+                                           term_freq_count);
+  if (posting_offset_count != terms_.Size() + 1 ||
+      posting_offsets_[terms_.Size()] != posting_count ||
+      term_freq_count != posting_count) {
+    ThrowCorrupted();
+  }
+
+  size_t data_count = 0;
+  size_t document_count = 0;
+  document_data_ = GetSection<IndexFileDocumentData>(
+      IndexFileSection::DOCUMENT_DATA, data_count);
+  document_ids_ =
+      GetSection<int32_t>(IndexFileSection::DOCUMENT_IDS, document_count);
+  if (document_count != header_->document_count ||
+      data_count != document_count || texts_.Size() != document_count ||
+      document_count > static_cast<size_t>(INT32_MAX)) {
+    ThrowCorrupted();
+  }
+}
+
+void MappedIndex::ThrowCorrupted() const {
+  throw std::runtime_error("Index file "s + path_ + " is corrupted"s);
+}
+
+bool MappedIndex::VerifyChecksum() const {
+  return UpdateIndexFileChecksum(INDEX_FILE_CHECKSUM_SEED,
+                                 data_ + sizeof(IndexFileHeader),
+                                 size_ - sizeof(IndexFileHeader)) ==
+         header_->checksum;
+}
+
+int MappedIndex::GetDocumentCount() const {
+  return static_cast<int>(header_->document_count);
+}
+
+std::string_view MappedIndex::GetDocumentText(int document_id) const {
+  const int32_t* end = document_ids_ + header_->document_count;
+  const int32_t* helper = std::lower_bound(document_ids_, end, document_id);
+  if (helper == end || *helper != document_id) {
+    return {};
+  }
+  return texts_[helper - document_ids_];
+}
+
+std::vector<Document> MappedIndex::FindTopDocuments(
+    std::string_view raw_query, DocumentStatus status,
+    size_t max_result_count) const {
+  return FindTopDocuments(
+      raw_query,
+      [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+      },
+      max_result_count);
+}
+
+std::vector<Document> MappedIndex::FindTopDocuments(
+    std::string_view raw_query) const {
+  return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+bool MappedIndex::IsStopWord(std::string_view word) const {
+  return stop_words_.Find(word) != stop_words_.Size();
+}
+
+bool MappedIndex::FindPostings(std::string_view word,
+                               PostingsView& postings) const {
+  const size_t term = terms_.Find(word);
+  if (term == terms_.Size()) {
+    return false;
+  }
+  const uint64_t first = posting_offsets_[term];
+  const uint64_t last = posting_offsets_[term + 1];
+  if (first > last || last > posting_offsets_[terms_.Size()]) {
+    ThrowCorrupted();
+  }
+  postings = {posting_ordinals_ + first, posting_term_freqs_ + first,
+              static_cast<size_t>(last - first)};
+  return true;
+}
@@ -0,0 +1,174 @@
+﻿#pragma once
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "index_file.h"
+#include "query.h"
+#include "score_accumulator.h"
+#include "search_server.h"
+#include "top_documents.h"
+
+// Read-only view of an index segment written by SearchServer::SaveIndex.
+// The file is memory mapped and queries read the posting lists in place, so
+// opening costs a few page faults instead of rebuilding the index. Opening
+// checks the header and the section tables only; the postings are
+// bounds-checked as queries read them, and a query that meets a corrupted
+// posting throws std::runtime_error.
+class MappedIndex {
+ public:
+  explicit MappedIndex(const std::string& path);
+  MappedIndex(const MappedIndex&) = delete;
+  MappedIndex& operator=(const MappedIndex&) = delete;
+  ~MappedIndex();
+
+  // Also covers the term frequencies and the texts, which queries do not
+  // check. It reads the whole file, so it is not done on open.
+  bool VerifyChecksum() const;
+
+  int GetDocumentCount() const;
+  std::string_view GetDocumentText(int document_id) const;
+
+  template <typename DocumentPredicate>
+  std::vector<Document> FindTopDocuments(
+      std::string_view raw_query, DocumentPredicate document_predicate,
+      size_t max_result_count =
+          SearchServer::MAX_RESULT_DOCUMENT_COUNT) const;
+  std::vector<Document> FindTopDocuments(
+      std::string_view raw_query, DocumentStatus status,
+      size_t max_result_count =
+          SearchServer::MAX_RESULT_DOCUMENT_COUNT) const;
+  std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+ private:
+  class StringTable {
+   public:
+    StringTable() = default;
+    // offsets[size] must be the number of chars; the other offsets are
+    // checked as the strings are read.
+    StringTable(const MappedIndex* index, const uint64_t* offsets,
+                const char* chars, size_t size)
+        : index_(index), offsets_(offsets), chars_(chars), size_(size) {}
+
+    size_t Size() const { return size_; }
+    std::string_view operator[](size_t i) const {
+      const uint64_t first = offsets_[i];
+      const uint64_t last = offsets_[i + 1];
+      if (first > last || last > offsets_[size_]) {
+        index_->ThrowCorrupted();
+      }
+      return {chars_ + first, static_cast<size_t>(last - first)};
+    }
+    // Position of str in the ascending table or Size() if it is absent.
+    size_t Find(std::string_view str) const;
+
+   private:
+    const MappedIndex* index_ = nullptr;
+    const uint64_t* offsets_ = nullptr;
+    const char* chars_ = nullptr;
+    size_t size_ = 0;
+  };
+
+  struct PostingsView {
+    const int32_t* ordinals;
+    const double* term_freqs;
+    size_t size;
+  };
+
+  std::string path_;
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#endif
+
+  const IndexFileHeader* header_ = nullptr;
+  StringTable stop_words_;
+  StringTable terms_;
+  const uint64_t* posting_offsets_ = nullptr;
+  const int32_t* posting_ordinals_ = nullptr;
+  const double* posting_term_freqs_ = nullptr;
+  // Both indexed by document ordinal.
+  const IndexFileDocumentData* document_data_ = nullptr;
+  const int32_t* document_ids_ = nullptr;
+  StringTable texts_;
+
+  void Map();
+  void Unmap();
+  void Validate();
+  [[noreturn]] void ThrowCorrupted() const;
+
+  template <typename T>
+  const T* GetSection(IndexFileSection section, size_t& count) const;
+
+  bool IsStopWord(std::string_view word) const;
+  bool FindPostings(std::string_view word, PostingsView& postings) const;
+};
+
+template <typename DocumentPredicate>
+std::vector<Document> MappedIndex::FindTopDocuments(
+    std::string_view raw_query, DocumentPredicate document_predicate,
+    size_t max_result_count) const {
+  const Query query = ParseQuery(
+      raw_query, [this](std::string_view word) { return IsStopWord(word); });
+
+  const size_t document_count = header_->document_count;
+  const auto check_ordinal = [this, document_count](int32_t ordinal) {
+    if (static_cast<uint32_t>(ordinal) >= document_count) {
+      ThrowCorrupted();
+    }
+    return ordinal;
+  };
+
+  ScoreAccumulator::Lease accumulator(document_count);
+  PostingsView postings;
+
+  for (const auto word : query.minus_words) {
+    if (FindPostings(word, postings)) {
+      for (size_t i = 0; i < postings.size; ++i) {
+        accumulator->Exclude(check_ordinal(postings.ordinals[i]));
+      }
+    }
+  }
+
+  // Computed as in SearchServer, so both score documents identically.
+  const double log_document_count =
+      log(static_cast<double>(GetDocumentCount()));
+  for (const auto word : query.plus_words) {
+    if (!FindPostings(word, postings)) {
+      continue;
+    }
+    const double inverse_document_freq =
+        log_document_count - log(static_cast<double>(postings.size));
+    for (size_t i = 0; i < postings.size; ++i) {
+      const int ordinal = check_ordinal(postings.ordinals[i]);
+      if (accumulator->IsExcluded(ordinal)) {
+        continue;
+      }
+      const IndexFileDocumentData& document_data = document_data_[ordinal];
+      if (static_cast<uint32_t>(document_data.status) >
+          static_cast<uint32_t>(DocumentStatus::REMOVED)) {
+        ThrowCorrupted();
+      }
+      if (document_predicate(document_ids_[ordinal],
+                             static_cast<DocumentStatus>(document_data.status),
+                             document_data.rating)) {
+        accumulator->Add(ordinal,
+                         postings.term_freqs[i] * inverse_document_freq);
+      }
+    }
+  }
+
+  TopDocuments top(max_result_count);
+  for (const int ordinal : accumulator->GetTouched()) {
+    if (!accumulator->IsExcluded(ordinal)) {
+      top.Add({document_ids_[ordinal], accumulator->GetRelevance(ordinal),
+               document_data_[ordinal].rating});
+    }
+  }
+  return top.Extract();
+}
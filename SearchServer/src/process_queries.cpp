@@ -2,31 +2,62 @@
 
 #include <algorithm>
 #include <execution>
+#include <string_view>
+#include <utility>
 
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
-  std::vector<std::vector<Document>> helper(queries.size());
-
-  std::transform(std::execution::par, queries.begin(), queries.end(),
-                 helper.begin(), [&search_server](std::string query) {
-                   return search_server.FindTopDocuments(query);
-                 });
-
-  return helper;
+  return search_server.FindTopDocumentsBatch(
+      std::execution::par,
+      std::vector<std::string_view>(queries.begin(), queries.end()));
 }
 
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
-  return std::transform_reduce(
-      std::execution::par, queries.begin(), queries.end(),
-      std::vector<Document>{},
-      [](std::vector<Document> lhs, std::vector<Document> const& rhs) {
-        lhs.insert(lhs.end(), rhs.begin(), rhs.end());
-        return lhs;
-      },
-      [&search_server](const std::string& query) {
-        return search_server.FindTopDocuments(query);
-      });
+  std::vector<Document> documents;
+  for (auto& query_documents : ProcessQueries(search_server, queries)) {
+    documents.insert(documents.end(), query_documents.begin(),
+                     query_documents.end());
+  }
+  return documents;
+}
+
+JoinedDocuments::JoinedDocuments(const SearchServer& search_server,
+                                 std::vector<std::string> queries)
+    : search_server_(&search_server),
+      queries_(std::make_shared<const std::vector<std::string>>(
+          std::move(queries))) {
+  LoadChunks();
+}
+
+void JoinedDocuments::Advance() {
+  if (++position_ == documents_.size()) {
+    LoadChunks();
+  }
+}
+
+void JoinedDocuments::LoadChunks() {
+  documents_.clear();
+  position_ = 0;
+  const std::vector<std::string>& queries = *queries_;
+  while (documents_.empty() && next_query_ < queries.size()) {
+    const size_t last_query =
+        std::min(queries.size(), next_query_ + CHUNK_SIZE);
+    const auto chunk_documents = search_server_->FindTopDocumentsBatch(
+        std::execution::par,
+        std::vector<std::string_view>(queries.begin() + next_query_,
+                                      queries.begin() + last_query));
+    for (const auto& query_documents : chunk_documents) {
+      documents_.insert(documents_.end(), query_documents.begin(),
+                        query_documents.end());
+    }
+    next_query_ = last_query;
+  }
+}
+
+JoinedDocuments StreamQueriesJoined(const SearchServer& search_server,
+                                    std::vector<std::string> queries) {
+  return JoinedDocuments(search_server, std::move(queries));
 }
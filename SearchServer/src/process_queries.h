@@ -1,5 +1,7 @@
 #pragma once
 
+#include <iterator>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -9,4 +11,70 @@ std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server, const std::vector<std::string>& queries);
 
 std::vector<Document> ProcessQueriesJoined(const SearchServer& search_server,
-    const std::vector<std::string>& queries);
\ No newline at end of file
+    const std::vector<std::string>& queries);
+
+// Documents found for all queries, in query order, as a single-pass range.
+// Queries are answered CHUNK_SIZE at a time while the range is iterated, so
+// only the results of one chunk are held however long the batch is. The
+// range owns its queries, and copies share them but iterate on their own.
+// The server must outlive the range.
+class JoinedDocuments {
+ public:
+  static constexpr size_t CHUNK_SIZE = 4096;
+
+  class Iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = Document;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Document*;
+    using reference = const Document&;
+
+    explicit Iterator(JoinedDocuments* documents) : documents_(documents) {}
+
+    reference operator*() const { return documents_->GetCurrent(); }
+    pointer operator->() const { return &documents_->GetCurrent(); }
+    Iterator& operator++() {
+      documents_->Advance();
+      return *this;
+    }
+    void operator++(int) { ++*this; }
+
+    // Iterators only tell whether they are at the end.
+    bool operator==(const Iterator& other) const {
+      return IsEnd() == other.IsEnd();
+    }
+    bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+   private:
+    JoinedDocuments* documents_;
+
+    bool IsEnd() const { return !documents_ || documents_->IsEnd(); }
+  };
+
+  JoinedDocuments(const SearchServer& search_server,
+                  std::vector<std::string> queries);
+
+  Iterator begin() { return Iterator(this); }
+  Iterator end() { return Iterator(nullptr); }
+
+ private:
+  const SearchServer* search_server_;
+  std::shared_ptr<const std::vector<std::string>> queries_;
+  // First query of the next chunk.
+  size_t next_query_ = 0;
+  std::vector<Document> documents_;
+  size_t position_ = 0;
+
+  bool IsEnd() const { return position_ == documents_.size(); }
+  const Document& GetCurrent() const { return documents_[position_]; }
+  void Advance();
+  // Answers chunks until one of them finds any documents or the queries run
+  // out.
+  void LoadChunks();
+};
+
+// The same documents as ProcessQueriesJoined without building the joined
+// vector.
+JoinedDocuments StreamQueriesJoined(const SearchServer& search_server,
+                                    std::vector<std::string> queries);
\ No newline at end of file
@@ -0,0 +1,25 @@
+﻿#include "query.h"
+
+#include <stdexcept>
+#include <string>
+
+using namespace std::string_literals;
+
+QueryWord ParseQueryWord(std::string_view text, bool is_valid) {
+  if (text.empty()) {
+    throw std::invalid_argument("Query word is empty"s);
+  }
+
+  bool is_minus = false;
+
+  if (text[0] == '-') {
+    is_minus = true;
+    text = text.substr(1);
+  }
+
+  if (text.empty() || text[0] == '-' || !is_valid) {
+    throw std::invalid_argument("Query word "s + std::string(text) +
+                                " is invalid");
+  }
+  return {text, is_minus};
+}
@@ -0,0 +1,62 @@
+﻿#pragma once
+#include <algorithm>
+#include <string_view>
+#include <vector>
+
+#include "inverted_index.h"
+#include "string_processing.h"
+
+struct QueryWord {
+  std::string_view data;
+  bool is_minus;
+};
+
+struct Query {
+  std::vector<std::string_view> plus_words;
+  std::vector<std::string_view> minus_words;
+};
+
+// Query resolved against the term dictionary of an index: ascending unique
+// ids of the plus and minus words. Words the dictionary does not know are
+// left out, as they match no document.
+struct TermQuery {
+  std::vector<InvertedIndex::TermId> plus_terms;
+  std::vector<InvertedIndex::TermId> minus_terms;
+  // Weights of the plus terms, in the same order. They follow from the
+  // terms and the index, so two queries with the same terms are equal.
+  std::vector<double> inverse_document_freqs;
+};
+
+// is_valid tells whether text is free of control characters, as reported by
+// the tokenizer.
+QueryWord ParseQueryWord(std::string_view text, bool is_valid);
+
+// Splits raw_query into plus and minus words, leaves out the stop words and
+// sorts and deduplicates both lists.
+template <typename StopWordPredicate>
+Query ParseQuery(std::string_view raw_query, StopWordPredicate is_stop_word) {
+  Query result;
+
+  ForEachWord(raw_query, [&](std::string_view word, bool is_valid) {
+    const auto query_word = ParseQueryWord(word, is_valid);
+    if (!is_stop_word(query_word.data)) {
+      if (query_word.is_minus) {
+        result.minus_words.push_back(query_word.data);
+      } else {
+        result.plus_words.push_back(query_word.data);
+      }
+    }
+  });
+
+  std::sort(result.minus_words.begin(), result.minus_words.end());
+  std::sort(result.plus_words.begin(), result.plus_words.end());
+
+  result.minus_words.erase(
+      std::unique(result.minus_words.begin(), result.minus_words.end()),
+      result.minus_words.end());
+  result.plus_words.erase(
+      std::unique(result.plus_words.begin(), result.plus_words.end()),
+      result.plus_words.end());
+
+  return result;
+}
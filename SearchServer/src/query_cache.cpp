@@ -0,0 +1,65 @@
+﻿#include "query_cache.h"
+
+QueryCache::QueryCache(size_t capacity) : capacity_(capacity) {}
+
+bool QueryCache::Find(const Key& key, uint64_t generation,
+                      std::vector<Document>& documents) {
+  std::lock_guard guard(mutex_);
+  const auto helper = positions_.find(key);
+  if (helper == positions_.end()) {
+    ++stats_.miss_count;
+    return false;
+  }
+  if (helper->second->generation != generation) {
+    entries_.erase(helper->second);
+    positions_.erase(helper);
+    ++stats_.miss_count;
+    return false;
+  }
+  entries_.splice(entries_.begin(), entries_, helper->second);
+  documents = entries_.front().documents;
+  ++stats_.hit_count;
+  return true;
+}
+
+void QueryCache::Insert(Key key, uint64_t generation,
+                        std::vector<Document> documents) {
+  if (capacity_ == 0) {
+    return;
+  }
+  std::lock_guard guard(mutex_);
+  const auto helper = positions_.find(key);
+  if (helper != positions_.end()) {
+    helper->second->generation = generation;
+    helper->second->documents = std::move(documents);
+    entries_.splice(entries_.begin(), entries_, helper->second);
+    return;
+  }
+  if (entries_.size() == capacity_) {
+    positions_.erase(entries_.back().key);
+    entries_.pop_back();
+    ++stats_.eviction_count;
+  }
+  entries_.push_front({std::move(key), generation, std::move(documents)});
+  positions_.emplace(entries_.front().key, entries_.begin());
+}
+
+size_t QueryCache::GetCapacity() const { return capacity_; }
+
+QueryCacheStats QueryCache::GetStats() const {
+  std::lock_guard guard(mutex_);
+  return stats_;
+}
+
+size_t QueryCache::KeyHasher::operator()(const Key& key) const {
+  size_t hash = static_cast<size_t>(key.status) * 37 + key.max_result_count;
+  for (const auto term_id : key.query.plus_terms) {
+    hash = hash * 37 + term_id;
+  }
+  // Keeps a term apart from the same term negated.
+  hash = hash * 37 + 1;
+  for (const auto term_id : key.query.minus_terms) {
+    hash = hash * 37 + term_id;
+  }
+  return hash;
+}
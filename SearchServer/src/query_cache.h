@@ -0,0 +1,65 @@
+﻿#pragma once
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+#include "query.h"
+
+struct QueryCacheStats {
+  uint64_t hit_count = 0;
+  uint64_t miss_count = 0;
+  uint64_t eviction_count = 0;
+};
+
+// Size-bounded LRU cache of top documents. Entries are keyed by the resolved
+// query, so queries that differ only in word order, repeats, stop words or
+// unknown words share an entry. Every entry remembers the index generation it
+// was computed for and is not returned once the index has changed.
+class QueryCache {
+ public:
+  // Term ids are only meaningful within one generation of the index, which
+  // is all the cache ever serves an entry for.
+  struct Key {
+    TermQuery query;
+    DocumentStatus status;
+    size_t max_result_count;
+
+    bool operator==(const Key& other) const {
+      return status == other.status &&
+             max_result_count == other.max_result_count &&
+             query.plus_terms == other.query.plus_terms &&
+             query.minus_terms == other.query.minus_terms;
+    }
+  };
+
+  explicit QueryCache(size_t capacity);
+
+  bool Find(const Key& key, uint64_t generation,
+            std::vector<Document>& documents);
+  void Insert(Key key, uint64_t generation, std::vector<Document> documents);
+
+  size_t GetCapacity() const;
+  QueryCacheStats GetStats() const;
+
+ private:
+  struct KeyHasher {
+    size_t operator()(const Key& key) const;
+  };
+
+  struct Entry {
+    Key key;
+    uint64_t generation;
+    std::vector<Document> documents;
+  };
+
+  const size_t capacity_;
+
+  mutable std::mutex mutex_;
+  // Most recently used first.
+  std::list<Entry> entries_;
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHasher> positions_;
+  QueryCacheStats stats_;
+};
@@ -1,31 +1,259 @@
-﻿//#include "remove_duplicates.h"
-//
-//#include "log_duration.h"
-//
-//using namespace std::string_literals;
-//
-//void RemoveDuplicates(SearchServer& search_server) {
-//  LOG_DURATION_STREAM("Remove duplicates", std::cout);
-//  std::set<int> id_remove;
-//  std::map<std::set<std::string>, int> unique_word_plus_id;
-//  for (const int document_id : search_server) {
-//    std::map<std::string, double> all_words;
-//
-//    all_words = search_server.GetWordFrequencies(document_id);
-//    std::set<std::string> unique_words;
-//
-//    for (auto [word, _] : all_words) {
-//      unique_words.insert(word);
-//    }
-//
-//    if (unique_word_plus_id.count(unique_words)) {
-//      id_remove.insert(document_id);
-//    } else {
-//      unique_word_plus_id.insert(std::pair{unique_words, document_id});
-//    }
-//  }
-//  for (auto id_ : id_remove) {
-//    std::cout << "Found duplicate document id " << id_ << std::endl;
-//    search_server.RemoveDocument(id_);
-//  }
-//}
+﻿#include "remove_duplicates.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+using namespace std::string_literals;
+
+namespace {
+
+// Documents a task handles at least.
+constexpr size_t MIN_DOCUMENTS_PER_TASK = 256;
+
+ThreadPool* SelectThreadPool(const std::execution::sequenced_policy&,
+                             const SearchServer&) {
+  return nullptr;
+}
+
+ThreadPool* SelectThreadPool(const std::execution::parallel_policy&,
+                             const SearchServer& search_server) {
+  return search_server.GetThreadPool().get();
+}
+
+// Odd multipliers and offsets of the hash functions of the signatures,
+// drawn from splitmix64. a * h + b is a permutation of the 64-bit values.
+std::vector<std::pair<uint64_t, uint64_t>> MakeMinHashFunctions(size_t count) {
+  std::vector<std::pair<uint64_t, uint64_t>> functions(count);
+  uint64_t state = 0;
+  const auto next = [&state] {
+    uint64_t value = (state += 0x9e3779b97f4a7c15ULL);
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+  };
+  for (auto& [multiplier, offset] : functions) {
+    multiplier = next() | 1;
+    offset = next();
+  }
+  return functions;
+}
+
+std::vector<int> FindDuplicates(ThreadPool* thread_pool,
+                                const SearchServer& search_server) {
+  const std::vector<int> document_ids(search_server.begin(),
+                                      search_server.end());
+  std::vector<std::pair<uint64_t, int>> fingerprints(document_ids.size());
+  ParallelFor(thread_pool, document_ids.size(), MIN_DOCUMENTS_PER_TASK,
+              [&](size_t i) {
+                fingerprints[i] = {
+                    search_server.GetWordSetFingerprint(document_ids[i]),
+                    document_ids[i]};
+              });
+
+  return FindDuplicatesByFingerprint(search_server, std::move(fingerprints));
+}
+
+std::vector<int> FindNearDuplicates(ThreadPool* thread_pool,
+                                    const SearchServer& search_server,
+                                    const NearDuplicateOptions& options) {
+  if (options.band_count == 0 || options.rows_per_band == 0) {
+    throw std::invalid_argument("Bands and rows must not be empty"s);
+  }
+  const size_t row_count = options.band_count * options.rows_per_band;
+  const auto functions = MakeMinHashFunctions(row_count);
+
+  const std::vector<int> document_ids(search_server.begin(),
+                                      search_server.end());
+  // Row r of document i at signatures[i * row_count + r], and the hash of
+  // band b at band_hashes[i * band_count + b].
+  std::vector<uint64_t> signatures(document_ids.size() * row_count);
+  std::vector<uint64_t> band_hashes(document_ids.size() * options.band_count);
+  ParallelFor(
+      thread_pool, document_ids.size(), MIN_DOCUMENTS_PER_TASK,
+      [&](size_t i) {
+        const auto signature = signatures.begin() + i * row_count;
+        std::fill(signature, signature + row_count,
+                  std::numeric_limits<uint64_t>::max());
+        search_server.ForEachDocumentWord(
+            document_ids[i], [&](std::string_view word) {
+              const uint64_t hash = HashWord(word);
+              for (size_t row = 0; row < row_count; ++row) {
+                const auto& [multiplier, offset] = functions[row];
+                signature[row] =
+                    std::min(signature[row], hash * multiplier + offset);
+              }
+            });
+        for (size_t band = 0; band < options.band_count; ++band) {
+          uint64_t band_hash = band;
+          for (size_t row = 0; row < options.rows_per_band; ++row) {
+            band_hash = (band_hash ^ signature[band * options.rows_per_band +
+                                               row]) *
+                        0x9e3779b97f4a7c15ULL;
+          }
+          band_hashes[i * options.band_count + band] = band_hash;
+        }
+      });
+
+  const auto min_equal_rows = static_cast<size_t>(
+      std::ceil(options.min_similarity * static_cast<double>(row_count)));
+  const auto is_similar = [&](size_t lhs, size_t rhs) {
+    size_t equal_rows = 0;
+    for (size_t row = 0; row < row_count; ++row) {
+      equal_rows += signatures[lhs * row_count + row] ==
+                    signatures[rhs * row_count + row];
+    }
+    return equal_rows >= min_equal_rows;
+  };
+
+  // In id order, every document is compared with the kept documents that
+  // share a band hash with it, and kept itself if it matches none.
+  std::vector<std::unordered_map<uint64_t, std::vector<size_t>>> kept_by_band(
+      options.band_count);
+  std::vector<size_t> compared;
+  std::vector<int> duplicate_ids;
+  for (size_t i = 0; i < document_ids.size(); ++i) {
+    bool is_duplicate = false;
+    compared.clear();
+    for (size_t band = 0; band < options.band_count && !is_duplicate;
+         ++band) {
+      const auto helper =
+          kept_by_band[band].find(band_hashes[i * options.band_count + band]);
+      if (helper == kept_by_band[band].end()) {
+        continue;
+      }
+      for (const size_t kept : helper->second) {
+        if (std::find(compared.begin(), compared.end(), kept) !=
+            compared.end()) {
+          continue;
+        }
+        compared.push_back(kept);
+        if (is_similar(i, kept)) {
+          is_duplicate = true;
+          break;
+        }
+      }
+    }
+    if (is_duplicate) {
+      duplicate_ids.push_back(document_ids[i]);
+    } else {
+      for (size_t band = 0; band < options.band_count; ++band) {
+        kept_by_band[band][band_hashes[i * options.band_count + band]]
+            .push_back(i);
+      }
+    }
+  }
+  return duplicate_ids;
+}
+
+template <typename ExecutionPolicy>
+void RemoveDocumentsFound(const ExecutionPolicy& policy,
+                          SearchServer& search_server,
+                          const std::vector<int>& document_ids) {
+  for (const int document_id : document_ids) {
+    std::cout << "Found duplicate document id "s << document_id << std::endl;
+  }
+  search_server.RemoveDocuments(policy, document_ids);
+}
+
+}  // namespace
+
+std::vector<int> FindDuplicatesByFingerprint(
+    const SearchServer& search_server,
+    std::vector<std::pair<uint64_t, int>> fingerprints) {
+  std::sort(fingerprints.begin(), fingerprints.end());
+  std::vector<int> duplicate_ids;
+  // Kept documents of the current fingerprint, one per distinct word set;
+  // there is more than one only when fingerprints collide.
+  std::vector<int> kept_ids;
+  for (size_t i = 0; i < fingerprints.size(); ++i) {
+    const auto& [fingerprint, document_id] = fingerprints[i];
+    if (i == 0 || fingerprint != fingerprints[i - 1].first) {
+      kept_ids.clear();
+    }
+    if (std::any_of(kept_ids.begin(), kept_ids.end(), [&](int kept_id) {
+          return search_server.HaveSameWords(kept_id, document_id);
+        })) {
+      duplicate_ids.push_back(document_id);
+    } else {
+      kept_ids.push_back(document_id);
+    }
+  }
+  std::sort(duplicate_ids.begin(), duplicate_ids.end());
+  return duplicate_ids;
+}
+
+std::vector<int> FindDuplicates(const SearchServer& search_server) {
+  return FindDuplicates(std::execution::seq, search_server);
+}
+
+std::vector<int> FindDuplicates(const std::execution::sequenced_policy& policy,
+                                const SearchServer& search_server) {
+  return FindDuplicates(SelectThreadPool(policy, search_server),
+                        search_server);
+}
+
+std::vector<int> FindDuplicates(const std::execution::parallel_policy& policy,
+                                const SearchServer& search_server) {
+  return FindDuplicates(SelectThreadPool(policy, search_server),
+                        search_server);
+}
+
+std::vector<int> FindNearDuplicates(const SearchServer& search_server,
+                                    const NearDuplicateOptions& options) {
+  return FindNearDuplicates(std::execution::seq, search_server, options);
+}
+
+std::vector<int> FindNearDuplicates(
+    const std::execution::sequenced_policy& policy,
+    const SearchServer& search_server, const NearDuplicateOptions& options) {
+  return FindNearDuplicates(SelectThreadPool(policy, search_server),
+                            search_server, options);
+}
+
+std::vector<int> FindNearDuplicates(
+    const std::execution::parallel_policy& policy,
+    const SearchServer& search_server, const NearDuplicateOptions& options) {
+  return FindNearDuplicates(SelectThreadPool(policy, search_server),
+                            search_server, options);
+}
+
+void RemoveDuplicates(SearchServer& search_server) {
+  RemoveDuplicates(std::execution::seq, search_server);
+}
+
+void RemoveDuplicates(const std::execution::sequenced_policy& policy,
+                      SearchServer& search_server) {
+  RemoveDocumentsFound(policy, search_server,
+                       FindDuplicates(policy, search_server));
+}
+
+void RemoveDuplicates(const std::execution::parallel_policy& policy,
+                      SearchServer& search_server) {
+  RemoveDocumentsFound(policy, search_server,
+                       FindDuplicates(policy, search_server));
+}
+
+void RemoveNearDuplicates(SearchServer& search_server,
+                          const NearDuplicateOptions& options) {
+  RemoveNearDuplicates(std::execution::seq, search_server, options);
+}
+
+void RemoveNearDuplicates(const std::execution::sequenced_policy& policy,
+                          SearchServer& search_server,
+                          const NearDuplicateOptions& options) {
+  RemoveDocumentsFound(policy, search_server,
+                       FindNearDuplicates(policy, search_server, options));
+}
+
+void RemoveNearDuplicates(const std::execution::parallel_policy& policy,
+                          SearchServer& search_server,
+                          const NearDuplicateOptions& options) {
+  RemoveDocumentsFound(policy, search_server,
+                       FindNearDuplicates(policy, search_server, options));
+}
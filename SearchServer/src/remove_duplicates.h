@@ -1,5 +1,63 @@
-﻿//#pragma once
-//
-//#include "search_server.h"
-//
-//void RemoveDuplicates(SearchServer& search_server);
+﻿#pragma once
+#include <cstdint>
+#include <execution>
+#include <utility>
+#include <vector>
+
+#include "search_server.h"
+
+// Search for near duplicates by MinHash. Every document gets a signature of
+// band_count * rows_per_band minima of its hashed words under as many hash
+// functions; two signatures agree in a row with the probability that equals
+// the Jaccard similarity s of the word sets. Documents are compared only when
+// all rows of one of their bands agree, which happens with probability
+// 1 - (1 - s^rows_per_band)^band_count.
+struct NearDuplicateOptions {
+  size_t band_count = 16;
+  size_t rows_per_band = 4;
+  // Compared documents are duplicates when their signatures agree in at
+  // least this fraction of the rows.
+  double min_similarity = 0.8;
+};
+
+// Ascending ids of the documents with the same set of words as a document
+// with a smaller id. Documents are grouped by GetWordSetFingerprint, and the
+// words of the documents of a group are then compared, so documents whose
+// fingerprints collide are never taken for duplicates.
+std::vector<int> FindDuplicates(const SearchServer& search_server);
+std::vector<int> FindDuplicates(const std::execution::sequenced_policy&,
+                                const SearchServer& search_server);
+std::vector<int> FindDuplicates(const std::execution::parallel_policy&,
+                                const SearchServer& search_server);
+
+// The same for the given (fingerprint, document id) pairs, which must give
+// documents with the same words the same fingerprint.
+std::vector<int> FindDuplicatesByFingerprint(
+    const SearchServer& search_server,
+    std::vector<std::pair<uint64_t, int>> fingerprints);
+
+// Ascending ids of the documents that are near duplicates of a document with
+// a smaller id that is not one itself.
+std::vector<int> FindNearDuplicates(const SearchServer& search_server,
+                                    const NearDuplicateOptions& options = {});
+std::vector<int> FindNearDuplicates(const std::execution::sequenced_policy&,
+                                    const SearchServer& search_server,
+                                    const NearDuplicateOptions& options = {});
+std::vector<int> FindNearDuplicates(const std::execution::parallel_policy&,
+                                    const SearchServer& search_server,
+                                    const NearDuplicateOptions& options = {});
+
+// Report every document found on std::cout and remove them in one batch.
+void RemoveDuplicates(SearchServer& search_server);
+void RemoveDuplicates(const std::execution::sequenced_policy&,
+                      SearchServer& search_server);
+void RemoveDuplicates(const std::execution::parallel_policy&,
+                      SearchServer& search_server);
+void RemoveNearDuplicates(SearchServer& search_server,
+                          const NearDuplicateOptions& options = {});
+void RemoveNearDuplicates(const std::execution::sequenced_policy&,
+                          SearchServer& search_server,
+                          const NearDuplicateOptions& options = {});
+void RemoveNearDuplicates(const std::execution::parallel_policy&,
+                          SearchServer& search_server,
+                          const NearDuplicateOptions& options = {});
@@ -1,25 +1,100 @@
 ﻿#include "request_queue.h"
- 
-std::vector<Document> RequestQueue::AddFindRequest(std::string_view raw_query, 
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+RequestQueue::RequestQueue(const SearchServer& search_server,
+                           Clock::duration bucket_width, size_t bucket_count)
+    : search_server_(search_server),
+      bucket_width_(bucket_width),
+      start_(Clock::now()),
+      buckets_(bucket_count) {
+  if (bucket_width <= Clock::duration::zero()) {
+    throw std::invalid_argument("Bucket width must be positive"s);
+  }
+  if (bucket_count == 0) {
+    throw std::invalid_argument("Bucket count must be positive"s);
+  }
+}
+
+std::vector<Document> RequestQueue::AddFindRequest(std::string_view raw_query,
                                                    DocumentStatus status) {
-    return AddFindRequest(raw_query, 
-                          [&status](int document_id, 
-                                    DocumentStatus document_status, 
-                                    int rating) {
-                                        return document_status == status;
-                                    });
-}
-    
+  return AddFindRequest(
+      raw_query, [status](int, DocumentStatus document_status, int) {
+        return document_status == status;
+      });
+}
+
 std::vector<Document> RequestQueue::AddFindRequest(std::string_view raw_query) {
-    
-    return AddFindRequest(raw_query,
-                          DocumentStatus::ACTUAL);
+  return AddFindRequest(raw_query, DocumentStatus::ACTUAL);
 }
-    
+
 int RequestQueue::GetNoResultRequests() const {
-    return count_if(requests_.begin(), 
-                    requests_.end(), 
-                    [](QueryResult query) {
-                        return query.query_result == 0;
-                    });
-}
\ No newline at end of file
+  return static_cast<int>(GetNoResultRequests(GetWindow()));
+}
+
+uint64_t RequestQueue::GetNoResultRequests(Clock::duration window) const {
+  const auto [first, last] = GetBucketRange(Clock::now(), window);
+  uint64_t no_result_count = 0;
+  for (uint64_t number = first; number <= last; ++number) {
+    no_result_count +=
+        GetBucket(number).no_result_count.Get(static_cast<uint32_t>(number));
+  }
+  return no_result_count;
+}
+
+RequestStats RequestQueue::GetStats(Clock::duration window) const {
+  const auto now = Clock::now();
+  const auto [first, last] = GetBucketRange(now, window);
+  RequestStats stats;
+  for (uint64_t number = first; number <= last; ++number) {
+    const TimeBucket& bucket = GetBucket(number);
+    const auto tag = static_cast<uint32_t>(number);
+    stats.request_count += bucket.request_count.Get(tag);
+    stats.no_result_count += bucket.no_result_count.Get(tag);
+    for (size_t latency = 0; latency < LATENCY_BUCKET_COUNT; ++latency) {
+      if (const uint32_t count = bucket.latencies[latency].Get(tag)) {
+        stats.latencies.AddBucket(latency << LATENCY_BUCKET_SHIFT, count);
+      }
+    }
+  }
+  // From the start of the first bucket, which is never before the
+  // construction of the queue.
+  const double seconds =
+      std::chrono::duration<double>(
+          now - (start_ + bucket_width_ * static_cast<Clock::rep>(first)))
+          .count();
+  if (seconds > 0.0) {
+    stats.requests_per_second = stats.request_count / seconds;
+  }
+  return stats;
+}
+
+std::pair<uint64_t, uint64_t> RequestQueue::GetBucketRange(
+    Clock::time_point now, Clock::duration window) const {
+  const uint64_t last = GetBucketNumber(now);
+  const auto window_buckets = static_cast<uint64_t>(std::clamp<Clock::rep>(
+      (window + bucket_width_ - Clock::duration(1)) / bucket_width_, 1,
+      static_cast<Clock::rep>(buckets_.size())));
+  return {last + 1 - std::min(window_buckets, last + 1), last};
+}
+
+void RequestQueue::AddRequest(Clock::time_point start, bool has_result) {
+  const auto finish = Clock::now();
+  const uint64_t number = GetBucketNumber(finish);
+  const auto tag = static_cast<uint32_t>(number);
+  TimeBucket& bucket = GetBucket(number);
+  bucket.request_count.Add(tag, 1);
+  if (!has_result) {
+    bucket.no_result_count.Add(tag, 1);
+  }
+  const size_t latency = std::min(
+      LatencyHistogram::GetBucket(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start)
+              .count()) >>
+          LATENCY_BUCKET_SHIFT,
+      LATENCY_BUCKET_COUNT - 1);
+  bucket.latencies[latency].Add(tag, 1);
+}
@@ -1,12 +1,40 @@
 ﻿#pragma once
-#include <deque>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
 
+#include "search_metrics.h"
 #include "search_server.h"
 
+struct RequestStats {
+  uint64_t request_count = 0;
+  uint64_t no_result_count = 0;
+  double requests_per_second = 0.0;
+  // Latencies of the requests, to within a quarter of their value.
+  LatencyHistogram latencies;
+};
+
+// Thread-safe front door over a shared server that keeps statistics of the
+// requests over a sliding window of time. The window is a ring of
+// bucket_count buckets of bucket_width each, so memory stays fixed whatever
+// the request rate, and a statistic costs a pass over the buckets it covers,
+// however many requests they hold. Requests from any number of threads
+// update the buckets with atomic operations only.
 class RequestQueue {
  public:
-  RequestQueue(const SearchServer& search_server)
-      : search_request(search_server) {}
+  using Clock = std::chrono::steady_clock;
+
+  // A day in minutes.
+  static constexpr Clock::duration DEFAULT_BUCKET_WIDTH =
+      std::chrono::minutes(1);
+  static constexpr size_t DEFAULT_BUCKET_COUNT = 1440;
+
+  explicit RequestQueue(const SearchServer& search_server,
+                        Clock::duration bucket_width = DEFAULT_BUCKET_WIDTH,
+                        size_t bucket_count = DEFAULT_BUCKET_COUNT);
 
   template <typename DocumentPredicate>
   std::vector<Document> AddFindRequest(std::string_view raw_query,
@@ -15,30 +43,84 @@ class RequestQueue {
                                        DocumentStatus status);
   std::vector<Document> AddFindRequest(std::string_view raw_query);
 
+  // Over the whole window.
   int GetNoResultRequests() const;
+  // Over the last window, rounded up to whole buckets and cut to the whole
+  // window. The current bucket is counted as far as it has gone.
+  uint64_t GetNoResultRequests(Clock::duration window) const;
+  RequestStats GetStats(Clock::duration window) const;
+
+  Clock::duration GetWindow() const {
+    return bucket_width_ * static_cast<Clock::rep>(buckets_.size());
+  }
 
  private:
-  struct QueryResult {
-    bool query_result;
+  static constexpr int MAX_LATENCY_BITS = 36;
+  static constexpr int LATENCY_BUCKET_SHIFT = 2;
+  // Every LATENCY_BUCKET_SHIFT-th bucket of LatencyHistogram up to
+  // 2^MAX_LATENCY_BITS ns, about a minute; longer latencies count as the
+  // last one.
+  static constexpr size_t LATENCY_BUCKET_COUNT =
+      ((MAX_LATENCY_BITS - LatencyHistogram::SUB_BUCKET_BITS + 1)
+       << LatencyHistogram::SUB_BUCKET_BITS) >>
+      LATENCY_BUCKET_SHIFT;
+
+  // A count of one time bucket tagged with the number of the bucket in its
+  // upper half. The first add for a newer bucket starts the count over, so
+  // a bucket is reused without a reset that could race with concurrent adds.
+  class BucketCounter {
+   public:
+    void Add(uint32_t tag, uint32_t delta) {
+      uint64_t value = value_.load(std::memory_order_relaxed);
+      uint64_t updated;
+      do {
+        updated = (value >> 32) == tag ? value + delta
+                                       : (uint64_t{tag} << 32) + delta;
+      } while (!value_.compare_exchange_weak(value, updated,
+                                             std::memory_order_relaxed));
+    }
+    uint32_t Get(uint32_t tag) const {
+      const uint64_t value = value_.load(std::memory_order_relaxed);
+      return (value >> 32) == tag ? static_cast<uint32_t>(value) : 0;
+    }
+
+   private:
+    std::atomic<uint64_t> value_ = 0;
+  };
+
+  struct TimeBucket {
+    BucketCounter request_count;
+    BucketCounter no_result_count;
+    BucketCounter latencies[LATENCY_BUCKET_COUNT];
   };
 
-  const SearchServer& search_request;
-  std::deque<QueryResult> requests_;
-  const static int min_in_day_ = 1440;
+  const SearchServer& search_server_;
+  const Clock::duration bucket_width_;
+  const Clock::time_point start_;
+  std::vector<TimeBucket> buckets_;
+
+  uint64_t GetBucketNumber(Clock::time_point time) const {
+    return (time - start_) / bucket_width_;
+  }
+  TimeBucket& GetBucket(uint64_t number) {
+    return buckets_[number % buckets_.size()];
+  }
+  const TimeBucket& GetBucket(uint64_t number) const {
+    return buckets_[number % buckets_.size()];
+  }
+  // Numbers of the first bucket of the window and of the current one.
+  std::pair<uint64_t, uint64_t> GetBucketRange(Clock::time_point now,
+                                               Clock::duration window) const;
+
+  void AddRequest(Clock::time_point start, bool has_result);
 };
 
 template <typename DocumentPredicate>
 std::vector<Document> RequestQueue::AddFindRequest(
     std::string_view raw_query, DocumentPredicate document_predicate) {
+  const auto start = Clock::now();
   std::vector<Document> helper =
-      search_request.FindTopDocuments(raw_query, document_predicate);
-  QueryResult query;
-  query.query_result = (helper.empty() == false);
-
-  if (!(requests_.size() < min_in_day_)) {
-    requests_.pop_front();
-  }
-
-  requests_.push_back(query);
+      search_server_.FindTopDocuments(raw_query, document_predicate);
+  AddRequest(start, !helper.empty());
   return helper;
-}
\ No newline at end of file
+}
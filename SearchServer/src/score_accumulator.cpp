@@ -0,0 +1,33 @@
+﻿#include "score_accumulator.h"
+
+ScoreAccumulator::Lease::Lease(size_t document_id_bound) {
+  thread_local ScoreAccumulator thread_accumulator;
+  if (thread_accumulator.in_use_) {
+    own_ = std::make_unique<ScoreAccumulator>();
+    accumulator_ = own_.get();
+  } else {
+    accumulator_ = &thread_accumulator;
+  }
+  accumulator_->in_use_ = true;
+  accumulator_->Reserve(document_id_bound);
+}
+
+ScoreAccumulator::Lease::~Lease() {
+  accumulator_->Clear();
+  accumulator_->in_use_ = false;
+}
+
+void ScoreAccumulator::Reserve(size_t document_id_bound) {
+  if (relevances_.size() < document_id_bound) {
+    relevances_.resize(document_id_bound, 0.0);
+    states_.resize(document_id_bound, UNTOUCHED);
+  }
+}
+
+void ScoreAccumulator::Clear() {
+  for (const int document_id : touched_) {
+    relevances_[document_id] = 0.0;
+    states_[document_id] = UNTOUCHED;
+  }
+  touched_.clear();
+}
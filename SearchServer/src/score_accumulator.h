@@ -0,0 +1,67 @@
+﻿#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Dense relevance accumulator indexed by document ordinal. Only the entries
+// listed in the touched list are dirty, so clearing costs as much as the
+// query itself and the buffers are reused from query to query without new
+// allocations.
+class ScoreAccumulator {
+ public:
+  // Hands out the accumulator of the calling thread, or a private one if the
+  // thread's accumulator is already in use further up the stack.
+  class Lease {
+   public:
+    explicit Lease(size_t document_id_bound);
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+    ~Lease();
+
+    ScoreAccumulator& operator*() const { return *accumulator_; }
+    ScoreAccumulator* operator->() const { return accumulator_; }
+
+   private:
+    std::unique_ptr<ScoreAccumulator> own_;
+    ScoreAccumulator* accumulator_;
+  };
+
+  void Reserve(size_t document_id_bound);
+
+  void Add(int document_id, double relevance) {
+    Touch(document_id);
+    relevances_[document_id] += relevance;
+  }
+
+  void Exclude(int document_id) {
+    Touch(document_id);
+    states_[document_id] = EXCLUDED;
+  }
+
+  bool IsExcluded(int document_id) const {
+    return states_[document_id] == EXCLUDED;
+  }
+
+  double GetRelevance(int document_id) const {
+    return relevances_[document_id];
+  }
+
+  const std::vector<int>& GetTouched() const { return touched_; }
+
+  void Clear();
+
+ private:
+  enum State : uint8_t { UNTOUCHED, TOUCHED, EXCLUDED };
+
+  std::vector<double> relevances_;
+  std::vector<State> states_;
+  std::vector<int> touched_;
+  bool in_use_ = false;
+
+  void Touch(int document_id) {
+    if (states_[document_id] == UNTOUCHED) {
+      states_[document_id] = TOUCHED;
+      touched_.push_back(document_id);
+    }
+  }
+};
@@ -0,0 +1,168 @@
+﻿#include "search_metrics.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iomanip>
+#include <utility>
+
+namespace {
+
+std::atomic<uint64_t> next_metrics_id = 0;
+
+struct ThreadMetricsEntry {
+  uint64_t metrics_id;
+  std::weak_ptr<SearchMetrics::ThreadMetrics> thread_metrics;
+};
+
+// Blocks of the calling thread, with the last one used in front of them.
+thread_local uint64_t last_metrics_id = UINT64_MAX;
+thread_local SearchMetrics::ThreadMetrics* last_thread_metrics = nullptr;
+thread_local std::vector<ThreadMetricsEntry> thread_metrics_entries;
+
+}  // namespace
+
+size_t LatencyHistogram::GetBucket(uint64_t nanoseconds) {
+  if (nanoseconds < (uint64_t{1} << SUB_BUCKET_BITS)) {
+    return static_cast<size_t>(nanoseconds);
+  }
+  const int exponent = std::bit_width(nanoseconds) - 1;
+  const uint64_t sub_bucket = (nanoseconds >> (exponent - SUB_BUCKET_BITS)) &
+                              ((uint64_t{1} << SUB_BUCKET_BITS) - 1);
+  return (static_cast<size_t>(exponent - SUB_BUCKET_BITS + 1)
+          << SUB_BUCKET_BITS) +
+         sub_bucket;
+}
+
+uint64_t LatencyHistogram::GetBucketValue(size_t bucket) {
+  if (bucket < (size_t{1} << SUB_BUCKET_BITS)) {
+    return bucket;
+  }
+  const int exponent =
+      static_cast<int>(bucket >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS - 1;
+  const uint64_t sub_bucket = bucket & ((size_t{1} << SUB_BUCKET_BITS) - 1);
+  return ((uint64_t{1} << SUB_BUCKET_BITS) + sub_bucket)
+         << (exponent - SUB_BUCKET_BITS);
+}
+
+void LatencyHistogram::AddBucket(size_t bucket, uint64_t count) {
+  buckets_[bucket] += count;
+  count_ += count;
+  sum_ += static_cast<double>(GetBucketValue(bucket)) * count;
+}
+
+double LatencyHistogram::GetMean() const {
+  return count_ == 0 ? 0.0 : sum_ / count_;
+}
+
+uint64_t LatencyHistogram::GetPercentile(double fraction) const {
+  const uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(fraction * count_)));
+  uint64_t seen = 0;
+  for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+    seen += buckets_[bucket];
+    if (seen >= rank) {
+      return GetBucketValue(bucket);
+    }
+  }
+  return 0;
+}
+
+uint64_t LatencyHistogram::GetMax() const {
+  for (size_t bucket = BUCKET_COUNT; bucket-- > 0;) {
+    if (buckets_[bucket] > 0) {
+      return GetBucketValue(bucket);
+    }
+  }
+  return 0;
+}
+
+std::ostream& operator<<(std::ostream& output,
+                         const SearchMetricsSnapshot& snapshot) {
+  static const char* const COUNTER_NAMES[] = {"queries", "postings_scanned",
+                                              "candidates"};
+  static const char* const STAGE_NAMES[] = {"parse", "minus_filter", "score",
+                                            "top_k", "sort"};
+  for (size_t counter = 0; counter < QUERY_COUNTER_COUNT; ++counter) {
+    output << COUNTER_NAMES[counter] << ' ' << snapshot.counters[counter]
+           << '\n';
+  }
+  const auto flags = output.flags();
+  output << std::fixed << std::setprecision(3);
+  for (size_t stage = 0; stage < QUERY_STAGE_COUNT; ++stage) {
+    const LatencyHistogram& latencies = snapshot.stage_latencies[stage];
+    output << STAGE_NAMES[stage] << " count " << latencies.GetCount()
+           << " mean_us " << latencies.GetMean() / 1e3 << " p50_us "
+           << latencies.GetPercentile(0.5) / 1e3 << " p99_us "
+           << latencies.GetPercentile(0.99) / 1e3 << " p999_us "
+           << latencies.GetPercentile(0.999) / 1e3 << " max_us "
+           << latencies.GetMax() / 1e3 << '\n';
+  }
+  output.flags(flags);
+  return output;
+}
+
+SearchMetrics::SearchMetrics() : id_(next_metrics_id.fetch_add(1)) {}
+
+SearchMetrics::ThreadMetrics& SearchMetrics::GetThreadMetrics() const {
+  if (last_metrics_id == id_) {
+    return *last_thread_metrics;
+  }
+
+  std::shared_ptr<ThreadMetrics> thread_metrics;
+  // Entries of destroyed servers are dropped on the way.
+  std::erase_if(thread_metrics_entries, [&](const ThreadMetricsEntry& entry) {
+    if (entry.metrics_id == id_) {
+      thread_metrics = entry.thread_metrics.lock();
+    }
+    return entry.thread_metrics.expired();
+  });
+  if (!thread_metrics) {
+    thread_metrics = std::make_shared<ThreadMetrics>();
+    {
+      std::lock_guard guard(mutex_);
+      thread_metrics_.push_back(thread_metrics);
+    }
+    thread_metrics_entries.push_back({id_, thread_metrics});
+  }
+
+  last_metrics_id = id_;
+  last_thread_metrics = thread_metrics.get();
+  return *thread_metrics;
+}
+
+SearchMetricsSnapshot SearchMetrics::GetSnapshot() const {
+  SearchMetricsSnapshot snapshot;
+  std::lock_guard guard(mutex_);
+  for (const auto& thread_metrics : thread_metrics_) {
+    for (size_t counter = 0; counter < QUERY_COUNTER_COUNT; ++counter) {
+      snapshot.counters[counter] += thread_metrics->counters_[counter].load(
+          std::memory_order_relaxed);
+    }
+    for (size_t stage = 0; stage < QUERY_STAGE_COUNT; ++stage) {
+      for (size_t bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT;
+           ++bucket) {
+        const uint64_t count = thread_metrics->buckets_[stage][bucket].load(
+            std::memory_order_relaxed);
+        if (count > 0) {
+          snapshot.stage_latencies[stage].AddBucket(bucket, count);
+        }
+      }
+    }
+  }
+  return snapshot;
+}
+
+void SearchMetrics::Reset() {
+  std::lock_guard guard(mutex_);
+  for (const auto& thread_metrics : thread_metrics_) {
+    for (auto& counter : thread_metrics->counters_) {
+      counter.store(0, std::memory_order_relaxed);
+    }
+    for (auto& buckets : thread_metrics->buckets_) {
+      for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+}
@@ -0,0 +1,159 @@
+﻿#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Stages of answering a query. The parallel path does the minus filter
+// inside SCORE, Block-Max WAND both the minus filter and TOP_K.
+enum class QueryStage { PARSE, MINUS_FILTER, SCORE, TOP_K, SORT };
+inline constexpr size_t QUERY_STAGE_COUNT = 5;
+
+// POSTINGS_SCANNED counts the postings of all query terms for the
+// term-at-a-time paths and the postings of evaluated documents for Block-Max
+// WAND. CANDIDATES counts the documents a query term touched or, for
+// Block-Max WAND, the documents evaluated.
+enum class QueryCounter { QUERIES, POSTINGS_SCANNED, CANDIDATES };
+inline constexpr size_t QUERY_COUNTER_COUNT = 3;
+
+// Latencies in nanoseconds counted in log-linear buckets, as in an HDR
+// histogram: values below 2^SUB_BUCKET_BITS exactly, larger ones to within
+// 1/2^SUB_BUCKET_BITS of their value.
+class LatencyHistogram {
+ public:
+  static constexpr int SUB_BUCKET_BITS = 4;
+  static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1)
+                                         << SUB_BUCKET_BITS;
+
+  static size_t GetBucket(uint64_t nanoseconds);
+  // The smallest value that falls into bucket.
+  static uint64_t GetBucketValue(size_t bucket);
+
+  void Add(uint64_t nanoseconds) { AddBucket(GetBucket(nanoseconds), 1); }
+  void AddBucket(size_t bucket, uint64_t count);
+
+  uint64_t GetCount() const { return count_; }
+  double GetMean() const;
+  // The latency fraction of all latencies do not exceed, to the resolution
+  // of the buckets; 0 for an empty histogram.
+  uint64_t GetPercentile(double fraction) const;
+  uint64_t GetMax() const;
+
+ private:
+  std::vector<uint64_t> buckets_ = std::vector<uint64_t>(BUCKET_COUNT);
+  uint64_t count_ = 0;
+  // Sum of the bucket values, for the mean.
+  double sum_ = 0.0;
+};
+
+struct SearchMetricsSnapshot {
+  std::array<uint64_t, QUERY_COUNTER_COUNT> counters{};
+  std::array<LatencyHistogram, QUERY_STAGE_COUNT> stage_latencies;
+
+  uint64_t Get(QueryCounter counter) const {
+    return counters[static_cast<size_t>(counter)];
+  }
+  const LatencyHistogram& Get(QueryStage stage) const {
+    return stage_latencies[static_cast<size_t>(stage)];
+  }
+};
+
+// A line per counter and per stage, with the stage latencies in
+// microseconds.
+std::ostream& operator<<(std::ostream& output,
+                         const SearchMetricsSnapshot& snapshot);
+
+// Query metrics of one server. Every thread records into a block of its
+// own with plain relaxed loads and stores, so recording costs as much as an
+// ordinary increment and never waits; a snapshot sums the blocks of all
+// threads.
+class SearchMetrics {
+ public:
+  class ThreadMetrics {
+   public:
+    void Add(QueryCounter counter, uint64_t value) {
+      Increase(counters_[static_cast<size_t>(counter)], value);
+    }
+    void AddLatency(QueryStage stage, uint64_t nanoseconds) {
+      Increase(buckets_[static_cast<size_t>(stage)]
+                       [LatencyHistogram::GetBucket(nanoseconds)],
+               1);
+    }
+
+   private:
+    friend class SearchMetrics;
+
+    std::array<std::atomic<uint64_t>, QUERY_COUNTER_COUNT> counters_{};
+    std::array<std::array<std::atomic<uint64_t>,
+                          LatencyHistogram::BUCKET_COUNT>,
+               QUERY_STAGE_COUNT>
+        buckets_{};
+
+    // Only the owning thread writes.
+    static void Increase(std::atomic<uint64_t>& value, uint64_t delta) {
+      value.store(value.load(std::memory_order_relaxed) + delta,
+                  std::memory_order_relaxed);
+    }
+  };
+
+  SearchMetrics();
+  SearchMetrics(const SearchMetrics&) = delete;
+  SearchMetrics& operator=(const SearchMetrics&) = delete;
+
+  // The block of the calling thread, created on its first use.
+  ThreadMetrics& GetThreadMetrics() const;
+
+  SearchMetricsSnapshot GetSnapshot() const;
+  // Counts recorded while it runs may survive it.
+  void Reset();
+
+ private:
+  // Threads find their blocks by id, as a new server may reuse the address
+  // of a destroyed one.
+  const uint64_t id_;
+  mutable std::mutex mutex_;
+  mutable std::vector<std::shared_ptr<ThreadMetrics>> thread_metrics_;
+};
+
+// Records the stages of one query on the calling thread: each Lap is the
+// time since the previous one, or since construction.
+class QueryStopwatch {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit QueryStopwatch(const SearchMetrics& metrics)
+      : thread_metrics_(metrics.GetThreadMetrics()),
+        lap_start_(Clock::now()) {}
+
+  void Lap(QueryStage stage) {
+    const auto now = Clock::now();
+    thread_metrics_.AddLatency(
+        stage, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   now - lap_start_)
+                   .count());
+    lap_start_ = now;
+  }
+  void Add(QueryCounter counter, uint64_t value) {
+    thread_metrics_.Add(counter, value);
+  }
+
+ private:
+  SearchMetrics::ThreadMetrics& thread_metrics_;
+  Clock::time_point lap_start_;
+};
+
+// Without SEARCH_SERVER_METRICS the measurements, and the expressions passed
+// to them, are compiled out.
+#ifdef SEARCH_SERVER_METRICS
+#define QUERY_METRICS(name, metrics) QueryStopwatch name(metrics)
+#define QUERY_METRICS_LAP(name, stage) name.Lap(stage)
+#define QUERY_METRICS_ADD(name, counter, value) name.Add(counter, value)
+#else
+#define QUERY_METRICS(name, metrics)
+#define QUERY_METRICS_LAP(name, stage)
+#define QUERY_METRICS_ADD(name, counter, value)
+#endif
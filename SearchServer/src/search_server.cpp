@@ -1,27 +1,212 @@
 ﻿#include "search_server.h"
 
+#include <chrono>
+#include <cstdint>
+#include <exception>
 #include <numeric>
 
+#include "index_file.h"
+
 void SearchServer::AddDocument(int document_id, std::string_view document,
                                DocumentStatus status,
                                const std::vector<int>& ratings) {
-  if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+  if ((document_id < 0) || (document_ids_.count(document_id) > 0)) {
     throw std::invalid_argument("Invalid document ID"s);
   }
 
-  auto [doc_id_, doc_data_] = documents_.emplace(
-      document_id, DocumentData{std::string(document),
-                                ComputeAverageRating(ratings), status});
-  document_ids_.push_back(document_id);
+  const auto word_counts = ComputeWordCounts(document);
+  if (duplicate_policy_ == DuplicatePolicy::REJECT &&
+      HasIndexedDuplicate(word_counts)) {
+    throw std::invalid_argument("Duplicate document"s);
+  }
+
+  const int ordinal = AssignOrdinal(document_id);
+  auto& document_term_counts = ids_of_docs_to_term_counts_[document_id];
+  document_term_counts.reserve(word_counts.counts.size());
+  for (const auto& [word, count] : word_counts.counts) {
+    document_term_counts.emplace_back(
+        index_.AddPosting(word,
+                          {ordinal, count, count * word_counts.inv_word_count}),
+        count);
+  }
+  std::sort(document_term_counts.begin(), document_term_counts.end());
+
+  document_data_[ordinal] = {document_id, ComputeAverageRating(ratings), status,
+                             word_counts.inv_word_count, texts_.Add(document),
+                             word_counts.fingerprint};
+  document_ids_.insert(document_id);
+  fingerprint_ids_.emplace(word_counts.fingerprint, document_id);
+  OnDocumentCountChanged();
+}
+
+IndexingStats SearchServer::AddDocuments(
+    const std::vector<DocumentToAdd>& documents) {
+  return AddDocuments(std::execution::seq, documents);
+}
+
+IndexingStats SearchServer::AddDocuments(
+    const std::execution::sequenced_policy&,
+    const std::vector<DocumentToAdd>& documents) {
+  return AddDocumentsBatch(std::execution::seq, documents, 1);
+}
+
+IndexingStats SearchServer::AddDocuments(
+    const std::execution::parallel_policy&,
+    const std::vector<DocumentToAdd>& documents) {
+  return AddDocumentsBatch(std::execution::par, documents,
+                           thread_pool_->GetConcurrency());
+}
+
+// Tokenizing runs per document, then every slice of the batch builds its own
+// partial inverted index, and finally each term's runs from all slices are
+// merged into its posting list in one step. Merge tasks are sized by the
+// number of postings they merge.
+template <typename ExecutionPolicy>
+IndexingStats SearchServer::AddDocumentsBatch(
+    ExecutionPolicy&& policy, const std::vector<DocumentToAdd>& documents,
+    size_t slice_count) {
+  using Postings = std::vector<PostingList::Posting>;
+  const size_t MIN_DOCUMENTS_PER_TASK = 16;
+  const size_t MIN_POSTINGS_PER_TASK = 4096;
+
+  ThreadPool* const thread_pool = SelectThreadPool(policy);
+
+  const auto start_time = std::chrono::steady_clock::now();
+
+  std::set<int> new_document_ids;
+  for (const DocumentToAdd& document : documents) {
+    if ((document.id < 0) || (document_ids_.count(document.id) > 0) ||
+        !new_document_ids.insert(document.id).second) {
+      throw std::invalid_argument("Invalid document ID"s);
+    }
+  }
+
+  std::vector<WordCounts> word_counts(documents.size());
+  std::vector<std::exception_ptr> errors(documents.size());
+  ParallelFor(thread_pool, documents.size(), MIN_DOCUMENTS_PER_TASK,
+              [&](size_t i) {
+                try {
+                  word_counts[i] = ComputeWordCounts(documents[i].text);
+                } catch (...) {
+                  errors[i] = std::current_exception();
+                }
+              });
+  for (const std::exception_ptr& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  if (duplicate_policy_ == DuplicatePolicy::REJECT) {
+    // Documents of the batch by fingerprint, to find duplicates inside it.
+    std::unordered_multimap<uint64_t, size_t> new_fingerprints;
+    for (size_t i = 0; i < word_counts.size(); ++i) {
+      const auto [first, last] =
+          new_fingerprints.equal_range(word_counts[i].fingerprint);
+      if (HasIndexedDuplicate(word_counts[i]) ||
+          std::any_of(first, last, [&](const auto& entry) {
+            return HaveSameWords(word_counts[entry.second], word_counts[i]);
+          })) {
+        throw std::invalid_argument("Duplicate document"s);
+      }
+      new_fingerprints.emplace(word_counts[i].fingerprint, i);
+    }
+  }
+
+  std::vector<int> ordinals(documents.size());
+  for (size_t i = 0; i < documents.size(); ++i) {
+    ordinals[i] = AssignOrdinal(documents[i].id);
+  }
 
-  const auto words = SplitIntoWordsNoStop(doc_id_->second.data_string_);
+  slice_count = std::max<size_t>(1, std::min(slice_count, documents.size()));
+  std::vector<std::unordered_map<std::string_view, Postings>> partial_indexes(
+      slice_count);
+  ParallelFor(thread_pool, slice_count, 1, [&](size_t slice) {
+    const size_t first = documents.size() * slice / slice_count;
+    const size_t last = documents.size() * (slice + 1) / slice_count;
+    for (size_t i = first; i < last; ++i) {
+      const double inv_word_count = word_counts[i].inv_word_count;
+      for (const auto& [word, count] : word_counts[i].counts) {
+        partial_indexes[slice][word].push_back(
+            {ordinals[i], count, count * inv_word_count});
+      }
+    }
+  });
 
-  const double inv_word_count = 1.0 / words.size();
+  struct TermRuns {
+    InvertedIndex::TermId term_id;
+    PostingList* postings = nullptr;
+    std::vector<const Postings*> runs;
+  };
+  std::unordered_map<std::string_view, size_t> term_positions;
+  std::vector<TermRuns> terms;
+  size_t posting_count = 0;
+  for (const auto& partial_index : partial_indexes) {
+    for (const auto& [word, postings] : partial_index) {
+      const auto [helper, inserted] =
+          term_positions.emplace(word, terms.size());
+      if (inserted) {
+        terms.push_back({index_.InternTerm(word), nullptr, {}});
+      }
+      terms[helper->second].runs.push_back(&postings);
+      posting_count += postings.size();
+    }
+  }
+  // Posting lists may move while terms are added, so they are looked up
+  // only after the dictionary is complete.
+  for (TermRuns& term : terms) {
+    term.postings = &index_.GetPostings(term.term_id);
+  }
 
-  for (auto word : words) {
-    word_to_document_freqs_[word][document_id] += inv_word_count;
-    ids_of_docs_to_word_freqs_[document_id][word] += inv_word_count;
+  const size_t merge_grain_size =
+      MIN_POSTINGS_PER_TASK * terms.size() / std::max<size_t>(posting_count, 1);
+  ParallelFor(thread_pool, terms.size(), merge_grain_size, [&](size_t i) {
+    TermRuns& term = terms[i];
+    Postings postings;
+    for (const Postings* run : term.runs) {
+      postings.insert(postings.end(), run->begin(), run->end());
+    }
+    std::sort(postings.begin(), postings.end(),
+              [](const PostingList::Posting& lhs,
+                 const PostingList::Posting& rhs) {
+                return lhs.document_id < rhs.document_id;
+              });
+    term.postings->Add(postings);
+  });
+
+  std::vector<std::vector<std::pair<InvertedIndex::TermId, uint32_t>>>
+      document_term_counts(documents.size());
+  ParallelFor(thread_pool, documents.size(), MIN_DOCUMENTS_PER_TASK,
+              [&](size_t i) {
+                auto& document_counts = document_term_counts[i];
+                document_counts.reserve(word_counts[i].counts.size());
+                for (const auto& [word, count] : word_counts[i].counts) {
+                  document_counts.emplace_back(
+                      terms[term_positions.at(word)].term_id, count);
+                }
+                std::sort(document_counts.begin(), document_counts.end());
+              });
+
+  IndexingStats stats;
+  for (size_t i = 0; i < documents.size(); ++i) {
+    const DocumentToAdd& document = documents[i];
+    ids_of_docs_to_term_counts_[document.id] =
+        std::move(document_term_counts[i]);
+    document_data_[ordinals[i]] = {document.id,
+                                   ComputeAverageRating(document.ratings),
+                                   document.status,
+                                   word_counts[i].inv_word_count,
+                                   texts_.Add(document.text),
+                                   word_counts[i].fingerprint};
+    document_ids_.insert(document.id);
+    fingerprint_ids_.emplace(word_counts[i].fingerprint, document.id);
+    stats.byte_count += document.text.size();
   }
+  OnDocumentCountChanged();
+  stats.document_count = documents.size();
+  stats.seconds = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start_time)
+                      .count();
+  return stats;
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(
@@ -31,65 +216,505 @@ std::vector<Document> SearchServer::FindTopDocuments(
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(
-    std::string_view raw_query, DocumentStatus status) const {
-  return FindTopDocuments(std::execution::seq, raw_query, status);
+    std::string_view raw_query, DocumentStatus status,
+    size_t max_result_count) const {
+  return FindTopDocuments(std::execution::seq, raw_query, status,
+                          max_result_count);
+}
+
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsBatch(
+    const std::vector<std::string_view>& raw_queries, DocumentStatus status,
+    size_t max_result_count) const {
+  return FindTopDocumentsBatch(std::execution::seq, raw_queries, status,
+                               max_result_count);
+}
+
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsBatch(
+    const std::execution::sequenced_policy&,
+    const std::vector<std::string_view>& raw_queries, DocumentStatus status,
+    size_t max_result_count) const {
+  return FindTopDocumentsInGroups(std::execution::seq, raw_queries, status,
+                                  max_result_count);
+}
+
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsBatch(
+    const std::execution::parallel_policy&,
+    const std::vector<std::string_view>& raw_queries, DocumentStatus status,
+    size_t max_result_count) const {
+  return FindTopDocumentsInGroups(std::execution::par, raw_queries, status,
+                                  max_result_count);
+}
+
+// Identical queries are answered once. The rest are ordered by their plus
+// terms, longest posting list first, and cut into groups of
+// QUERY_GROUP_SIZE, so queries that share their most expensive terms end up
+// in the same group.
+template <typename ExecutionPolicy>
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsInGroups(
+    ExecutionPolicy&& policy, const std::vector<std::string_view>& raw_queries,
+    DocumentStatus status, size_t max_result_count) const {
+  const size_t QUERY_GROUP_SIZE = 16;
+  const size_t MIN_QUERIES_PER_PARSE_TASK = 64;
+
+  ThreadPool* const thread_pool = SelectThreadPool(policy);
+
+  std::vector<TermQuery> queries(raw_queries.size());
+  std::vector<std::exception_ptr> errors(raw_queries.size());
+  ParallelFor(thread_pool, raw_queries.size(), MIN_QUERIES_PER_PARSE_TASK,
+              [&](size_t i) {
+                try {
+                  queries[i] = ParseQuery(raw_queries[i]);
+                } catch (...) {
+                  errors[i] = std::current_exception();
+                }
+              });
+  for (const std::exception_ptr& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  const auto is_less = [&queries](size_t lhs, size_t rhs) {
+    return std::tie(queries[lhs].plus_terms, queries[lhs].minus_terms) <
+           std::tie(queries[rhs].plus_terms, queries[rhs].minus_terms);
+  };
+  std::vector<size_t> positions(raw_queries.size());
+  std::iota(positions.begin(), positions.end(), 0);
+  std::sort(positions.begin(), positions.end(), is_less);
+  // Position in unique_queries of every query of the batch.
+  std::vector<size_t> unique_positions(raw_queries.size());
+  std::vector<size_t> unique_queries;
+  for (const size_t i : positions) {
+    if (unique_queries.empty() || is_less(unique_queries.back(), i)) {
+      unique_queries.push_back(i);
+    }
+    unique_positions[i] = unique_queries.size() - 1;
+  }
+
+  std::vector<std::vector<Document>> unique_results(unique_queries.size());
+  std::vector<size_t> pending;
+  for (size_t i = 0; i < unique_queries.size(); ++i) {
+    if (!query_cache_ ||
+        !query_cache_->Find({queries[unique_queries[i]], status,
+                             max_result_count},
+                            generation_, unique_results[i])) {
+      pending.push_back(i);
+    }
+  }
+
+  std::vector<std::vector<InvertedIndex::TermId>> group_keys(
+      unique_queries.size());
+  for (const size_t i : pending) {
+    auto& key = group_keys[i];
+    key = queries[unique_queries[i]].plus_terms;
+    std::sort(key.begin(), key.end(),
+              [this](InvertedIndex::TermId lhs, InvertedIndex::TermId rhs) {
+                return index_.GetPostings(lhs).Size() >
+                       index_.GetPostings(rhs).Size();
+              });
+  }
+  std::stable_sort(pending.begin(), pending.end(),
+                   [&group_keys](size_t lhs, size_t rhs) {
+                     return group_keys[lhs] < group_keys[rhs];
+                   });
+
+  const size_t group_count =
+      (pending.size() + QUERY_GROUP_SIZE - 1) / QUERY_GROUP_SIZE;
+  ParallelFor(thread_pool, group_count, 1, [&](size_t group) {
+    const size_t first = group * QUERY_GROUP_SIZE;
+    const size_t last = std::min(pending.size(), first + QUERY_GROUP_SIZE);
+    std::vector<const TermQuery*> group_queries;
+    for (size_t i = first; i < last; ++i) {
+      group_queries.push_back(&queries[unique_queries[pending[i]]]);
+    }
+    auto group_results =
+        FindGroupTopDocuments(group_queries, status, max_result_count);
+    for (size_t i = first; i < last; ++i) {
+      unique_results[pending[i]] = std::move(group_results[i - first]);
+    }
+  });
+
+  if (query_cache_) {
+    for (const size_t i : pending) {
+      query_cache_->Insert({queries[unique_queries[i]], status,
+                            max_result_count},
+                           generation_, unique_results[i]);
+    }
+  }
+
+  std::vector<std::vector<Document>> results(raw_queries.size());
+  for (size_t i = 0; i < raw_queries.size(); ++i) {
+    results[i] = unique_results[unique_positions[i]];
+  }
+  return results;
+}
+
+// Walks the range of document ordinals in slices of SLICE_SIZE documents, small
+// enough for the accumulators of the whole group to stay in cache. Every
+// term of the group has one cursor, so each block is decoded once for all
+// the queries that use the term, and the term's score for a document is
+// computed once and added to each of them. Terms are visited in ascending
+// id order, the order every query lists them in, so relevance is summed
+// exactly as by FindAllDocuments.
+std::vector<std::vector<Document>> SearchServer::FindGroupTopDocuments(
+    const std::vector<const TermQuery*>& queries, DocumentStatus status,
+    size_t max_result_count) const {
+  const int SLICE_SIZE = 4096;
+
+  struct GroupTerm {
+    double inverse_document_freq;
+    PostingList::Cursor cursor;
+    // Positions in queries of the queries that use the term.
+    std::vector<size_t> queries;
+  };
+  const auto collect_terms = [&](auto terms_of) {
+    std::map<InvertedIndex::TermId, std::vector<size_t>> term_queries;
+    for (size_t i = 0; i < queries.size(); ++i) {
+      for (const auto term_id : terms_of(*queries[i])) {
+        term_queries[term_id].push_back(i);
+      }
+    }
+    std::vector<GroupTerm> terms;
+    terms.reserve(term_queries.size());
+    for (auto& [term_id, term_query_positions] : term_queries) {
+      const auto [postings, inverse_document_freq] = GetTermHandle(term_id);
+      terms.push_back({inverse_document_freq,
+                       PostingList::Cursor(*postings),
+                       std::move(term_query_positions)});
+    }
+    return terms;
+  };
+  std::vector<GroupTerm> plus_terms = collect_terms(
+      [](const TermQuery& query) -> const auto& { return query.plus_terms; });
+  std::vector<GroupTerm> minus_terms = collect_terms(
+      [](const TermQuery& query) -> const auto& { return query.minus_terms; });
+
+  std::vector<TopDocuments> tops(queries.size(),
+                                 TopDocuments(max_result_count));
+  std::vector<ScoreAccumulator> accumulators(queries.size());
+  for (ScoreAccumulator& accumulator : accumulators) {
+    accumulator.Reserve(SLICE_SIZE);
+  }
+
+  const int ordinal_bound = static_cast<int>(document_data_.size());
+  for (int first_ordinal = 0; first_ordinal < ordinal_bound;
+       first_ordinal += SLICE_SIZE) {
+    const int last_ordinal =
+        std::min(ordinal_bound, first_ordinal + SLICE_SIZE);
+
+    for (GroupTerm& term : minus_terms) {
+      PostingList::Cursor& cursor = term.cursor;
+      for (; !cursor.IsEnd() && cursor.DocumentId() < last_ordinal;
+           cursor.Next()) {
+        for (const size_t i : term.queries) {
+          accumulators[i].Exclude(cursor.DocumentId() - first_ordinal);
+        }
+      }
+    }
+
+    for (GroupTerm& term : plus_terms) {
+      PostingList::Cursor& cursor = term.cursor;
+      for (; !cursor.IsEnd() && cursor.DocumentId() < last_ordinal;
+           cursor.Next()) {
+        const int ordinal = cursor.DocumentId();
+        const DocumentData& document_data = document_data_[ordinal];
+        if (document_data.status != status) {
+          continue;
+        }
+        const double relevance = cursor.Count() *
+                                 document_data.inv_word_count *
+                                 term.inverse_document_freq;
+        const int slot = ordinal - first_ordinal;
+        for (const size_t i : term.queries) {
+          if (!accumulators[i].IsExcluded(slot)) {
+            accumulators[i].Add(slot, relevance);
+          }
+        }
+      }
+    }
+
+    for (size_t i = 0; i < queries.size(); ++i) {
+      for (const int slot : accumulators[i].GetTouched()) {
+        if (!accumulators[i].IsExcluded(slot)) {
+          const DocumentData& document_data =
+              document_data_[first_ordinal + slot];
+          tops[i].Add({document_data.id, accumulators[i].GetRelevance(slot),
+                       document_data.rating});
+        }
+      }
+      accumulators[i].Clear();
+    }
+  }
+
+  std::vector<std::vector<Document>> results;
+  results.reserve(queries.size());
+  for (TopDocuments& top : tops) {
+    results.push_back(top.Extract());
+  }
+  return results;
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(
+    std::string_view raw_query, const CollectionStats& stats,
+    DocumentStatus status, size_t max_result_count) const {
+  return FindTopDocuments(
+      raw_query, stats,
+      [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+      },
+      max_result_count);
+}
+
+int SearchServer::GetDocumentCount() const { return document_ids_.size(); }
+
+int SearchServer::GetDocumentFreq(std::string_view word) const {
+  const auto term_id = index_.FindTerm(word);
+  return term_id == InvertedIndex::NO_TERM
+             ? 0
+             : static_cast<int>(index_.GetPostings(term_id).Size());
+}
+
+IndexMemoryUsage SearchServer::GetIndexMemoryUsage() const {
+  return {index_.GetPostingCount(), index_.GetPostingMemoryUsage(),
+          texts_.GetCapacity()};
 }
 
-int SearchServer::GetDocumentCount() const { return documents_.size(); }
+void SearchServer::SetQueryEvaluation(QueryEvaluation query_evaluation) {
+  query_evaluation_ = query_evaluation;
+}
+
+QueryEvaluation SearchServer::GetQueryEvaluation() const {
+  return query_evaluation_;
+}
+
+void SearchServer::SetDuplicatePolicy(DuplicatePolicy duplicate_policy) {
+  duplicate_policy_ = duplicate_policy;
+}
+
+DuplicatePolicy SearchServer::GetDuplicatePolicy() const {
+  return duplicate_policy_;
+}
+
+void SearchServer::SetQueryCacheCapacity(size_t capacity) {
+  if (capacity == 0) {
+    query_cache_.reset();
+  } else {
+    query_cache_ = std::make_unique<QueryCache>(capacity);
+  }
+}
 
-std::vector<int>::const_iterator SearchServer::begin() const {
+QueryCacheStats SearchServer::GetQueryCacheStats() const {
+  return query_cache_ ? query_cache_->GetStats() : QueryCacheStats{};
+}
+
+void SearchServer::SetThreadPool(std::shared_ptr<ThreadPool> thread_pool) {
+  if (!thread_pool) {
+    throw std::invalid_argument("Thread pool is null"s);
+  }
+  thread_pool_ = std::move(thread_pool);
+}
+
+const std::shared_ptr<ThreadPool>& SearchServer::GetThreadPool() const {
+  return thread_pool_;
+}
+
+SearchMetricsSnapshot SearchServer::GetMetricsSnapshot() const {
+  return metrics_->GetSnapshot();
+}
+
+void SearchServer::ResetMetrics() { metrics_->Reset(); }
+
+std::optional<int> SearchServer::GetDocumentOrdinal(int document_id) const {
+  const auto helper = document_ordinals_.find(document_id);
+  if (helper == document_ordinals_.end()) {
+    return std::nullopt;
+  }
+  return helper->second;
+}
+
+std::optional<DocumentToAdd> SearchServer::GetDocument(
+    int document_id) const {
+  const auto ordinal = GetDocumentOrdinal(document_id);
+  if (!ordinal) {
+    return std::nullopt;
+  }
+  const DocumentData& document_data = document_data_[*ordinal];
+  return DocumentToAdd{document_id, texts_.Get(document_data.text_id),
+                       document_data.status, {document_data.rating}};
+}
+
+std::set<int>::const_iterator SearchServer::begin() const {
   return document_ids_.begin();
 }
 
-std::vector<int>::const_iterator SearchServer::end() const {
+std::set<int>::const_iterator SearchServer::end() const {
   return document_ids_.end();
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(
+std::map<std::string_view, double> SearchServer::GetWordFrequencies(
     int document_id) const {
-  static const std::map<std::string_view, double> emptyes;
-  return (!ids_of_docs_to_word_freqs_.count(document_id))
-             ? emptyes
-             : ids_of_docs_to_word_freqs_.at(document_id);
+  std::map<std::string_view, double> word_freqs;
+  const auto helper = ids_of_docs_to_term_counts_.find(document_id);
+  if (helper != ids_of_docs_to_term_counts_.end()) {
+    const double inv_word_count = GetDocumentData(document_id).inv_word_count;
+    for (const auto& [term_id, count] : helper->second) {
+      word_freqs.emplace(index_.GetTerm(term_id), count * inv_word_count);
+    }
+  }
+  return word_freqs;
 }
 
-void SearchServer::RemoveDocument(int document_id) {
-  RemoveDocument(std::execution::seq, document_id);
+uint64_t SearchServer::GetWordSetFingerprint(int document_id) const {
+  const auto ordinal = GetDocumentOrdinal(document_id);
+  return ordinal ? document_data_[*ordinal].fingerprint : 0;
 }
 
-void SearchServer::RemoveDocument(const std::execution::sequenced_policy&,
-                                  int document_id) {
-  auto helper =
-      std::find(document_ids_.begin(), document_ids_.end(), document_id);
+std::optional<int> SearchServer::FindDuplicateOf(int document_id) const {
+  const auto ordinal = GetDocumentOrdinal(document_id);
+  if (!ordinal) {
+    return std::nullopt;
+  }
+  std::optional<int> duplicate_id;
+  const auto [first, last] =
+      fingerprint_ids_.equal_range(document_data_[*ordinal].fingerprint);
+  for (auto helper = first; helper != last; ++helper) {
+    if (helper->second != document_id &&
+        (!duplicate_id || helper->second < *duplicate_id) &&
+        HaveSameWords(document_id, helper->second)) {
+      duplicate_id = helper->second;
+    }
+  }
+  return duplicate_id;
+}
 
-  if (helper == document_ids_.end()) {
-    return;
-  } else {
-    document_ids_.erase(helper);
+bool SearchServer::HaveSameWords(int lhs_document_id,
+                                 int rhs_document_id) const {
+  static const std::vector<std::pair<InvertedIndex::TermId, uint32_t>>
+      no_terms;
+  const auto find_terms = [this](int document_id) -> const auto& {
+    const auto helper = ids_of_docs_to_term_counts_.find(document_id);
+    return helper != ids_of_docs_to_term_counts_.end() ? helper->second
+                                                       : no_terms;
+  };
+  const auto& lhs_terms = find_terms(lhs_document_id);
+  const auto& rhs_terms = find_terms(rhs_document_id);
+  return std::equal(lhs_terms.begin(), lhs_terms.end(), rhs_terms.begin(),
+                    rhs_terms.end(), [](const auto& lhs, const auto& rhs) {
+                      return lhs.first == rhs.first;
+                    });
+}
+
+void SearchServer::SaveIndex(const std::string& path) const {
+  static_assert(sizeof(int) == sizeof(int32_t));
+  IndexFileWriter writer(path);
+
+  writer.WriteStrings(
+      IndexFileSection::STOP_WORD_OFFSETS, IndexFileSection::STOP_WORD_CHARS,
+      std::vector<std::string_view>(stop_words_.begin(), stop_words_.end()));
+
+  auto term_ids = index_.GetTermIds();
+  std::sort(term_ids.begin(), term_ids.end(),
+            [this](InvertedIndex::TermId lhs, InvertedIndex::TermId rhs) {
+              return index_.GetTerm(lhs) < index_.GetTerm(rhs);
+            });
+  std::vector<std::string_view> terms;
+  terms.reserve(term_ids.size());
+  for (const auto term_id : term_ids) {
+    terms.push_back(index_.GetTerm(term_id));
+  }
+  writer.WriteStrings(IndexFileSection::TERM_OFFSETS,
+                      IndexFileSection::TERM_CHARS, terms);
+
+  std::vector<uint64_t> posting_offsets{0};
+  for (const auto term_id : term_ids) {
+    posting_offsets.push_back(posting_offsets.back() +
+                              index_.GetPostings(term_id).Size());
+  }
+  writer.WriteSection(IndexFileSection::POSTING_OFFSETS, posting_offsets);
+
+  // The file numbers documents by their position in ascending id order.
+  std::vector<int> file_ordinals(document_data_.size());
+  std::vector<IndexFileDocumentData> document_data;
+  std::vector<std::string_view> texts;
+  document_data.reserve(document_ids_.size());
+  texts.reserve(document_ids_.size());
+  for (const int document_id : document_ids_) {
+    const int ordinal = document_ordinals_.at(document_id);
+    file_ordinals[ordinal] = static_cast<int>(document_data.size());
+    document_data.push_back(
+        {document_data_[ordinal].rating,
+         static_cast<int32_t>(document_data_[ordinal].status)});
+    texts.push_back(texts_.Get(document_data_[ordinal].text_id));
+  }
+
+  std::vector<std::pair<int, double>> postings;
+  const auto get_postings = [&](InvertedIndex::TermId term_id) {
+    postings.clear();
+    index_.GetPostings(term_id).ForEach([&](int ordinal, uint32_t count) {
+      postings.emplace_back(file_ordinals[ordinal],
+                            count * document_data_[ordinal].inv_word_count);
+    });
+    std::sort(postings.begin(), postings.end());
+  };
+  std::vector<int> posting_ordinals;
+  writer.BeginSection(IndexFileSection::POSTING_ORDINALS);
+  for (const auto term_id : term_ids) {
+    get_postings(term_id);
+    posting_ordinals.clear();
+    for (const auto& [file_ordinal, _] : postings) {
+      posting_ordinals.push_back(file_ordinal);
+    }
+    writer.Append(posting_ordinals.data(), posting_ordinals.size());
+  }
+  writer.EndSection();
+  std::vector<double> term_freqs;
+  writer.BeginSection(IndexFileSection::POSTING_TERM_FREQS);
+  for (const auto term_id : term_ids) {
+    get_postings(term_id);
+    term_freqs.clear();
+    for (const auto& [_, term_freq] : postings) {
+      term_freqs.push_back(term_freq);
+    }
+    writer.Append(term_freqs.data(), term_freqs.size());
   }
+  writer.EndSection();
 
-  documents_.erase(document_id);
+  writer.WriteSection(IndexFileSection::DOCUMENT_DATA, document_data);
+  writer.WriteSection(
+      IndexFileSection::DOCUMENT_IDS,
+      std::vector<int>(document_ids_.begin(), document_ids_.end()));
+  writer.WriteStrings(IndexFileSection::TEXT_OFFSETS,
+                      IndexFileSection::TEXT_CHARS, texts);
 
-  std::for_each(word_to_document_freqs_.begin(), word_to_document_freqs_.end(),
-                [&](auto& helper) { helper.second.erase(document_id); });
+  writer.Finish(GetDocumentCount());
 }
 
-void SearchServer::RemoveDocument(const std::execution::parallel_policy&,
-                                  int document_id) {
-  auto helper = std::find(std::execution::par, document_ids_.begin(),
-                          document_ids_.end(), document_id);
+void SearchServer::RemoveDocument(int document_id) {
+  RemoveDocument(std::execution::seq, document_id);
+}
 
-  if (helper == document_ids_.end()) {
+void SearchServer::RemoveDocument(const std::execution::sequenced_policy&,
+                                  int document_id) {
+  if (document_ids_.erase(document_id) == 0) {
     return;
-  } else {
-    document_ids_.erase(helper);
   }
 
-  documents_.erase(document_id);
+  const int ordinal = document_ordinals_.at(document_id);
+  const auto helper = ids_of_docs_to_term_counts_.find(document_id);
+  for (const auto& [term_id, _] : helper->second) {
+    index_.ErasePosting(term_id, ordinal);
+  }
+  ids_of_docs_to_term_counts_.erase(helper);
+  texts_.Erase(document_data_[ordinal].text_id);
+  texts_.Compact();
+  EraseFingerprint(document_id);
+  ReleaseOrdinal(document_id);
+  OnDocumentCountChanged();
+}
 
-  std::for_each(std::execution::par, word_to_document_freqs_.begin(),
-                word_to_document_freqs_.end(),
-                [&](auto& helper) { helper.second.erase(document_id); });
+void SearchServer::RemoveDocument(const std::execution::parallel_policy&,
+                                  int document_id) {
+  RemoveDocuments(std::execution::par, std::vector<int>{document_id});
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus>
@@ -100,90 +725,165 @@ SearchServer::MatchDocument(std::string_view raw_query, int document_id) const {
 std::tuple<std::vector<std::string_view>, DocumentStatus>
 SearchServer::MatchDocument(const std::execution::sequenced_policy&,
                             std::string_view raw_query, int document_id) const {
-  if ((document_id < 0) || (documents_.count(document_id) <= 0)) {
+  if ((document_id < 0) || (document_ids_.count(document_id) <= 0)) {
     throw std::invalid_argument("Non-existent document ID"s);
   }
 
   const auto result = ParseQuery(raw_query);
+  const int ordinal = document_ordinals_.at(document_id);
+  const DocumentStatus status = document_data_[ordinal].status;
   std::vector<std::string_view> matched_words;
 
-  for (auto word : result.minus_words) {
-    if (word_to_document_freqs_.count(word) == 0) {
-      continue;
-    }
-    if (word_to_document_freqs_.at(word).count(document_id)) {
-      return {{}, documents_.at(document_id).status};
+  for (const auto term_id : result.minus_terms) {
+    if (index_.GetPostings(term_id).Contains(ordinal)) {
+      return {std::vector<std::string_view>{}, status};
     }
   }
 
-  for (auto word : result.plus_words) {
-    if (word_to_document_freqs_.count(word) == 0) {
-      continue;
-    }
-    if (word_to_document_freqs_.at(word).count(document_id)) {
-      matched_words.push_back(word);
+  for (const auto term_id : result.plus_terms) {
+    if (index_.GetPostings(term_id).Contains(ordinal)) {
+      matched_words.push_back(index_.GetTerm(term_id));
     }
   }
+  std::sort(matched_words.begin(), matched_words.end());
 
-  return {matched_words, documents_.at(document_id).status};
+  return {matched_words, status};
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus>
 SearchServer::MatchDocument(const std::execution::parallel_policy&,
                             std::string_view raw_query, int document_id) const {
-  if ((document_id < 0) || (documents_.count(document_id) <= 0)) {
+  if ((document_id < 0) || (document_ids_.count(document_id) <= 0)) {
     throw std::invalid_argument("Non-existent document ID"s);
   }
 
+  // A lookup decodes one block, so only very long queries are split.
+  const size_t MIN_TERMS_PER_TASK = 64;
+
   const auto& result = ParseQuery(raw_query);
+  const int ordinal = document_ordinals_.at(document_id);
+  const DocumentStatus status = document_data_[ordinal].status;
 
-  const auto& checker = [this, document_id](std::string_view word) {
-    const auto helper = word_to_document_freqs_.find(word);
-    return helper != word_to_document_freqs_.end() &&
-           helper->second.count(document_id);
+  const auto& checker = [this, ordinal](InvertedIndex::TermId term_id) {
+    return index_.GetPostings(term_id).Contains(ordinal);
   };
 
-  if (std::any_of(std::execution::par, result.minus_words.begin(),
-                  result.minus_words.end(), checker)) {
-    return {{}, documents_.at(document_id).status};
+  std::atomic<bool> is_excluded = false;
+  thread_pool_->ParallelFor(
+      result.minus_terms.size(), MIN_TERMS_PER_TASK, [&](size_t i) {
+        if (!is_excluded.load(std::memory_order_relaxed) &&
+            checker(result.minus_terms[i])) {
+          is_excluded.store(true, std::memory_order_relaxed);
+        }
+      });
+  if (is_excluded) {
+    return {std::vector<std::string_view>{}, status};
+  }
+
+  std::vector<char> is_matched(result.plus_terms.size());
+  thread_pool_->ParallelFor(
+      result.plus_terms.size(), MIN_TERMS_PER_TASK,
+      [&](size_t i) { is_matched[i] = checker(result.plus_terms[i]); });
+
+  std::vector<std::string_view> matched_words;
+  for (size_t i = 0; i < result.plus_terms.size(); ++i) {
+    if (is_matched[i]) {
+      matched_words.push_back(index_.GetTerm(result.plus_terms[i]));
+    }
+  }
+  std::sort(matched_words.begin(), matched_words.end());
+  return {matched_words, status};
+}
+
+int SearchServer::AssignOrdinal(int document_id) {
+  int ordinal = static_cast<int>(document_data_.size());
+  if (free_ordinals_.empty()) {
+    document_data_.emplace_back();
+  } else {
+    ordinal = free_ordinals_.back();
+    free_ordinals_.pop_back();
   }
+  document_ordinals_.emplace(document_id, ordinal);
+  return ordinal;
+}
 
-  std::vector<std::string_view> matched_words(result.plus_words.size());
+void SearchServer::ReleaseOrdinal(int document_id) {
+  const auto helper = document_ordinals_.find(document_id);
+  free_ordinals_.push_back(helper->second);
+  document_ordinals_.erase(helper);
+}
 
-  auto end =
-      std::copy_if(std::execution::par, result.plus_words.begin(),
-                   result.plus_words.end(), matched_words.begin(), checker);
+const SearchServer::DocumentData& SearchServer::GetDocumentData(
+    int document_id) const {
+  return document_data_[document_ordinals_.at(document_id)];
+}
 
-  std::sort(matched_words.begin(), end);
-  end = std::unique(std::execution::par, matched_words.begin(), end);
+ThreadPool* SearchServer::SelectThreadPool(
+    const std::execution::sequenced_policy&) const {
+  return nullptr;
+}
 
-  matched_words.erase(end, matched_words.end());
-  return {matched_words, documents_.at(document_id).status};
+ThreadPool* SearchServer::SelectThreadPool(
+    const std::execution::parallel_policy&) const {
+  return thread_pool_.get();
 }
 
 bool SearchServer::IsStopWord(std::string_view word) const {
   return stop_words_.count(word) > 0;
 }
 
-bool SearchServer::IsValidWord(std::string_view word) {
-  return std::none_of(word.begin(), word.end(),
-                      [](char c) { return c >= '\0' && c < ' '; });
-}
-
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(
+SearchServer::WordCounts SearchServer::ComputeWordCounts(
     std::string_view text) const {
-  std::vector<std::string_view> words;
-
-  for (std::string_view& word : SplitIntoWords(text)) {
-    if (!IsValidWord(word)) {
+  WordCounts word_counts;
+  size_t word_count = 0;
+  ForEachWord(text, [&](std::string_view word, bool is_valid) {
+    if (!is_valid) {
       throw std::invalid_argument("Word "s + std::string(word) +
                                   " is invalid"s);
     }
     if (!IsStopWord(word)) {
-      words.push_back(word);
+      if (++word_counts.counts[word] == 1) {
+        word_counts.fingerprint += HashWord(word);
+      }
+      ++word_count;
+    }
+  });
+
+  word_counts.inv_word_count = 1.0 / word_count;
+  return word_counts;
+}
+
+void SearchServer::EraseFingerprint(int document_id) {
+  const auto [first, last] =
+      fingerprint_ids_.equal_range(GetDocumentData(document_id).fingerprint);
+  for (auto helper = first; helper != last; ++helper) {
+    if (helper->second == document_id) {
+      fingerprint_ids_.erase(helper);
+      return;
     }
   }
-  return words;
+}
+
+bool SearchServer::HasIndexedDuplicate(const WordCounts& word_counts) const {
+  const auto [first, last] =
+      fingerprint_ids_.equal_range(word_counts.fingerprint);
+  return std::any_of(first, last, [&](const auto& entry) {
+    const auto& term_counts = ids_of_docs_to_term_counts_.at(entry.second);
+    return term_counts.size() == word_counts.counts.size() &&
+           std::all_of(term_counts.begin(), term_counts.end(),
+                       [&](const auto& term_count) {
+                         return word_counts.counts.count(
+                                    index_.GetTerm(term_count.first)) > 0;
+                       });
+  });
+}
+
+bool SearchServer::HaveSameWords(const WordCounts& lhs, const WordCounts& rhs) {
+  return lhs.counts.size() == rhs.counts.size() &&
+         std::all_of(lhs.counts.begin(), lhs.counts.end(),
+                     [&rhs](const auto& word_count) {
+                       return rhs.counts.count(word_count.first) > 0;
+                     });
 }
 
 int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
@@ -194,57 +894,64 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
   return rating_sum / static_cast<int>(ratings.size());
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(
-    std::string_view& text) const {
-  if (text.empty()) {
-    throw std::invalid_argument("Query word is empty"s);
-  }
-
-  bool is_minus = false;
+// Stop words never reach the dictionary, so looking a word up also filters
+// them out.
+TermQuery SearchServer::ParseQuery(std::string_view text) const {
+  QUERY_METRICS(metrics, *metrics_);
+  TermQuery result;
+  ForEachWord(text, [&](std::string_view word, bool is_valid) {
+    const auto query_word = ParseQueryWord(word, is_valid);
+    const auto term_id = index_.FindTerm(query_word.data);
+    if (term_id == InvertedIndex::NO_TERM) {
+      return;
+    }
+    if (query_word.is_minus) {
+      result.minus_terms.push_back(term_id);
+    } else {
+      result.plus_terms.push_back(term_id);
+    }
+  });
 
-  if (text[0] == '-') {
-    is_minus = true;
-    text = text.substr(1);
+  for (auto* terms : {&result.plus_terms, &result.minus_terms}) {
+    std::sort(terms->begin(), terms->end());
+    terms->erase(std::unique(terms->begin(), terms->end()), terms->end());
   }
-
-  if (text.empty() || text[0] == '-' || !IsValidWord(text)) {
-    throw std::invalid_argument("Query word "s + std::string(text) +
-                                " is invalid");
+  result.inverse_document_freqs.reserve(result.plus_terms.size());
+  for (const auto term_id : result.plus_terms) {
+    result.inverse_document_freqs.push_back(
+        GetTermHandle(term_id).inverse_document_freq);
   }
-  return {text, is_minus, IsStopWord(text)};
+  QUERY_METRICS_LAP(metrics, QueryStage::PARSE);
+  return result;
 }
 
-SearchServer::Query SearchServer::ParseQuery(std::string_view& text) const {
-  Query result;
+SearchServer::TermHandle SearchServer::GetTermHandle(
+    InvertedIndex::TermId term_id) const {
+  const PostingList& postings = index_.GetPostings(term_id);
+  return {&postings, log_document_count_ - postings.GetLogDocumentFreq()};
+}
 
-  for (std::string_view& word : SplitIntoWords(text)) {
-    const auto query_word = ParseQueryWord(word);
-    if (!query_word.is_stop) {
-      if (query_word.is_minus) {
-        result.minus_words.push_back(query_word.data);
-      } else {
-        result.plus_words.push_back(query_word.data);
-      }
+SearchServer::TermHandle SearchServer::GetTermHandle(const TermQuery& query,
+                                                    size_t plus_term) const {
+  return {&index_.GetPostings(query.plus_terms[plus_term]),
+          query.inverse_document_freqs[plus_term]};
+}
+
+void SearchServer::ApplyCollectionStats(const CollectionStats& stats,
+                                        TermQuery& query) const {
+  const double log_document_count =
+      std::log(static_cast<double>(stats.document_count));
+  for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+    const auto helper =
+        stats.document_freqs.find(index_.GetTerm(query.plus_terms[i]));
+    if (helper != stats.document_freqs.end() && helper->second > 0) {
+      query.inverse_document_freqs[i] =
+          log_document_count - std::log(static_cast<double>(helper->second));
     }
   }
-
-  std::sort(std::execution::par, result.minus_words.begin(),
-            result.minus_words.end());
-  std::sort(std::execution::par, result.plus_words.begin(),
-            result.plus_words.end());
-
-  result.minus_words.erase(
-      std::unique(result.minus_words.begin(), result.minus_words.end()),
-      result.minus_words.end());
-  result.plus_words.erase(
-      std::unique(result.plus_words.begin(), result.plus_words.end()),
-      result.plus_words.end());
-
-  return result;
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(
-    std::string_view& word) const {
-  return log(GetDocumentCount() * 1.0 /
-             word_to_document_freqs_.at(word).size());
+void SearchServer::OnDocumentCountChanged() {
+  ++generation_;
+  log_document_count_ = log(static_cast<double>(GetDocumentCount()));
 }
\ No newline at end of file
@@ -3,25 +3,89 @@
 #include <cmath>
 #include <execution>
 #include <future>
+#include <iterator>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
+#include <numeric>
+#include <optional>
 #include <random>
 #include <set>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
-#include "concurrent_map.h"
+#include "inverted_index.h"
 #include "log_duration.h"
+#include "query.h"
+#include "query_cache.h"
 #include "read_input_functions.h"
+#include "score_accumulator.h"
+#include "search_metrics.h"
 #include "string_processing.h"
+#include "thread_pool.h"
+#include "text_arena.h"
+#include "top_documents.h"
 
 using namespace std::string_literals;
 
+// How sequential queries are evaluated. TERM_AT_A_TIME scores every posting
+// of every plus word; BLOCK_MAX_WAND walks the postings document by document
+// and skips documents whose score bound cannot get them into the top.
+// Both return the same documents. Parallel queries always score every
+// posting.
+enum class QueryEvaluation { TERM_AT_A_TIME, BLOCK_MAX_WAND };
+
+// What adding a document with the same set of words as an indexed one does.
+// ALLOW indexes it, and FindDuplicateOf reports it; REJECT throws
+// std::invalid_argument and leaves the index as it was.
+enum class DuplicatePolicy { ALLOW, REJECT };
+
+// Memory held by the posting lists and the document texts, the bulk of the
+// index.
+struct IndexMemoryUsage {
+  size_t posting_count = 0;
+  size_t posting_bytes = 0;
+  size_t text_bytes = 0;
+
+  double GetBytesPerPosting() const {
+    return posting_count > 0 ? posting_bytes * 1.0 / posting_count : 0.0;
+  }
+};
+
+// Throughput of a bulk AddDocuments call.
+struct IndexingStats {
+  size_t document_count = 0;
+  size_t byte_count = 0;
+  double seconds = 0.0;
+
+  double GetDocumentsPerSecond() const {
+    return seconds > 0.0 ? document_count / seconds : 0.0;
+  }
+  double GetMegabytesPerSecond() const {
+    return seconds > 0.0 ? byte_count / (1024.0 * 1024.0) / seconds : 0.0;
+  }
+};
+
+// Size of a collection split between several servers and the number of its
+// documents that contain each query word. A server holding one part of the
+// collection ranks its documents with these instead of its own counts, so
+// relevances do not depend on how the collection is split.
+struct CollectionStats {
+  int document_count = 0;
+  std::unordered_map<std::string_view, int> document_freqs;
+};
+
 class SearchServer {
  public:
+  static constexpr size_t MAX_RESULT_DOCUMENT_COUNT = 5;
+
   template <typename StringContainer>
   SearchServer(const StringContainer& stop_words);
   SearchServer(const std::string& stop_words_text)
@@ -33,22 +97,35 @@ class SearchServer {
   void AddDocument(int document_id, std::string_view document,
                    DocumentStatus status, const std::vector<int>& ratings);
 
+  // Indexes a whole batch at once with the same result as calling
+  // AddDocument for each of them. If any document is invalid nothing is
+  // added.
+  IndexingStats AddDocuments(const std::vector<DocumentToAdd>& documents);
+  IndexingStats AddDocuments(const std::execution::sequenced_policy&,
+                             const std::vector<DocumentToAdd>& documents);
+  IndexingStats AddDocuments(const std::execution::parallel_policy&,
+                             const std::vector<DocumentToAdd>& documents);
+
   template <typename DocumentPredicate>
   std::vector<Document> FindTopDocuments(
-      std::string_view raw_query, DocumentPredicate document_predicate) const;
+      std::string_view raw_query, DocumentPredicate document_predicate,
+      size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
   template <typename ExecutionPolicy, typename DocumentPredicate>
   std::vector<Document> FindTopDocuments(
       ExecutionPolicy&& policy, std::string_view raw_query,
-      DocumentPredicate document_predicate) const;
+      DocumentPredicate document_predicate,
+      size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
   template <typename ExecutionPolicy>
-  std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy,
-                                         std::string_view raw_query,
-                                         DocumentStatus status) const;
+  std::vector<Document> FindTopDocuments(
+      ExecutionPolicy&& policy, std::string_view raw_query,
+      DocumentStatus status,
+      size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
-  std::vector<Document> FindTopDocuments(std::string_view raw_query,
-                                         DocumentStatus status) const;
+  std::vector<Document> FindTopDocuments(
+      std::string_view raw_query, DocumentStatus status,
+      size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
   template <typename ExecutionPolicy>
   std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy,
@@ -56,18 +133,108 @@ class SearchServer {
 
   std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
-  int GetDocumentCount() const;
-
-  std::vector<int>::const_iterator begin() const;
-  std::vector<int>::const_iterator end() const;
+  // Ranks by the inverse document frequencies of the whole collection
+  // described by stats. Query words stats leave out are weighted by this
+  // server's own counts. Results are never cached.
+  template <typename DocumentPredicate>
+  std::vector<Document> FindTopDocuments(std::string_view raw_query,
+                                         const CollectionStats& stats,
+                                         DocumentPredicate document_predicate,
+                                         size_t max_result_count) const;
+  std::vector<Document> FindTopDocuments(std::string_view raw_query,
+                                         const CollectionStats& stats,
+                                         DocumentStatus status,
+                                         size_t max_result_count) const;
+
+  // Answers a batch of queries with the same results as the status
+  // overloads of FindTopDocuments. Queries that use the same terms are
+  // scored together, so their posting lists are walked once per group
+  // instead of once per query.
+  std::vector<std::vector<Document>> FindTopDocumentsBatch(
+      const std::vector<std::string_view>& raw_queries,
+      DocumentStatus status = DocumentStatus::ACTUAL,
+      size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+  std::vector<std::vector<Document>> FindTopDocumentsBatch(
+      const std::execution::sequenced_policy&,
+      const std::vector<std::string_view>& raw_queries,
+      DocumentStatus status = DocumentStatus::ACTUAL,
+      size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+  std::vector<std::vector<Document>> FindTopDocumentsBatch(
+      const std::execution::parallel_policy&,
+      const std::vector<std::string_view>& raw_queries,
+      DocumentStatus status = DocumentStatus::ACTUAL,
+      size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
-  const std::map<std::string_view, double>& GetWordFrequencies(
-      int document_id) const;
+  int GetDocumentCount() const;
+  // Number of documents that contain word; 0 for unknown and stop words.
+  int GetDocumentFreq(std::string_view word) const;
+  IndexMemoryUsage GetIndexMemoryUsage() const;
+
+  void SetQueryEvaluation(QueryEvaluation query_evaluation);
+  QueryEvaluation GetQueryEvaluation() const;
+
+  void SetDuplicatePolicy(DuplicatePolicy duplicate_policy);
+  DuplicatePolicy GetDuplicatePolicy() const;
+
+  // Caches the results of the status overloads of FindTopDocuments for up to
+  // capacity distinct queries; 0 turns the cache off. Queries with a custom
+  // predicate are never cached.
+  void SetQueryCacheCapacity(size_t capacity);
+  QueryCacheStats GetQueryCacheStats() const;
+
+  // Pool the parallel overloads run on; ThreadPool::GetDefault() unless
+  // set. Several servers may share one.
+  void SetThreadPool(std::shared_ptr<ThreadPool> thread_pool);
+  const std::shared_ptr<ThreadPool>& GetThreadPool() const;
+
+  // Query counters and stage latencies of FindTopDocuments, recorded only
+  // in builds with SEARCH_SERVER_METRICS defined (the SearchServerMetrics
+  // project property); all zero otherwise.
+  SearchMetricsSnapshot GetMetricsSnapshot() const;
+  void ResetMetrics();
+
+  // Dense number of the document within this server, below the number of
+  // documents ever held at once; kept until the document is removed. Unlike
+  // GetDocument it allocates nothing, so it also serves as the cheap check
+  // whether the server holds a document.
+  std::optional<int> GetDocumentOrdinal(int document_id) const;
+
+  // The document in the form it can be added to another server in, with its
+  // average rating as the only rating. The text stays valid until the next
+  // document is removed.
+  std::optional<DocumentToAdd> GetDocument(int document_id) const;
+
+  std::set<int>::const_iterator begin() const;
+  std::set<int>::const_iterator end() const;
+
+  std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+  // Calls handler(word) for every distinct word of the document, in no
+  // particular order; does nothing for an unknown id.
+  template <typename Handler>
+  void ForEachDocumentWord(int document_id, Handler handler) const;
+  // Sum of HashWord over the distinct words of the document, so documents
+  // with the same set of words share it whatever the order and counts of
+  // their words. 0 for an unknown id, as for an empty set.
+  uint64_t GetWordSetFingerprint(int document_id) const;
+  // Whether both documents have the same set of words; unknown ids have
+  // none.
+  bool HaveSameWords(int lhs_document_id, int rhs_document_id) const;
+  // The smallest id of another document with the same set of words.
+  std::optional<int> FindDuplicateOf(int document_id) const;
 
   void RemoveDocument(int document_id);
   void RemoveDocument(const std::execution::sequenced_policy&, int document_id);
   void RemoveDocument(const std::execution::parallel_policy&, int document_id);
 
+  // Writes the whole index to a segment file that MappedIndex can serve.
+  void SaveIndex(const std::string& path) const;
+
+  template <typename DocumentIds>
+  void RemoveDocuments(const DocumentIds& document_ids);
+  template <typename ExecutionPolicy, typename DocumentIds>
+  void RemoveDocuments(ExecutionPolicy&& policy,
+                       const DocumentIds& document_ids);
+
   std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(
       std::string_view raw_query, int document_id) const;
   std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(
@@ -78,59 +245,124 @@ class SearchServer {
       int document_id) const;
 
  private:
+  // Postings store word counts; the term frequency of a word in a document
+  // is its count times inv_word_count.
   struct DocumentData {
-    std::string data_string_;
-    int rating;
-    DocumentStatus status;
+    int id = 0;
+    int rating = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    double inv_word_count = 0.0;
+    TextArena::TextId text_id = 0;
+    uint64_t fingerprint = 0;
   };
 
-  const double EPSILON = 1e-6;
-  const int MAX_RESULT_DOCUMENT_COUNT = 5;
+  struct WordCounts {
+    std::unordered_map<std::string_view, uint32_t> counts;
+    double inv_word_count = 0.0;
+    uint64_t fingerprint = 0;
+  };
 
   const std::set<std::string, std::less<>> stop_words_;
 
-  std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-  std::map<int, std::map<std::string_view, double>> ids_of_docs_to_word_freqs_;
-
-  std::map<int, DocumentData> documents_;
-  std::vector<int> document_ids_;
+  InvertedIndex index_;
+  // Term ids of every document, ascending, with their counts.
+  std::map<int, std::vector<std::pair<InvertedIndex::TermId, uint32_t>>>
+      ids_of_docs_to_term_counts_;
+
+  TextArena texts_;
+  // Documents are numbered with dense ordinals, and the posting lists, the
+  // score accumulators and document_data_ use them instead of document ids,
+  // so memory grows with the number of documents, not with the largest id.
+  // Ordinals of removed documents are reused.
+  std::vector<DocumentData> document_data_;
+  std::unordered_map<int, int> document_ordinals_;
+  std::vector<int> free_ordinals_;
+  std::set<int> document_ids_;
+  // Documents by the fingerprint of their word sets, so duplicates are
+  // found as they are added.
+  std::unordered_multimap<uint64_t, int> fingerprint_ids_;
+
+  QueryEvaluation query_evaluation_ = QueryEvaluation::TERM_AT_A_TIME;
+  DuplicatePolicy duplicate_policy_ = DuplicatePolicy::ALLOW;
+
+  // Changes with every added or removed document, so cached results of an
+  // older index are never served.
+  uint64_t generation_ = 0;
+  // log(GetDocumentCount()), so a term's inverse document frequency is a
+  // single subtraction.
+  double log_document_count_ = 0.0;
+  std::unique_ptr<QueryCache> query_cache_;
+  std::shared_ptr<ThreadPool> thread_pool_ = ThreadPool::GetDefault();
+  // Present in every build, so the layout of the class does not depend on
+  // SEARCH_SERVER_METRICS; without it nothing is ever recorded here.
+  std::unique_ptr<SearchMetrics> metrics_ = std::make_unique<SearchMetrics>();
+
+  // Where the loops of an overload run: inline for the sequenced policy,
+  // on thread_pool_ for the parallel one.
+  ThreadPool* SelectThreadPool(const std::execution::sequenced_policy&) const;
+  ThreadPool* SelectThreadPool(const std::execution::parallel_policy&) const;
 
   bool IsStopWord(std::string_view word) const;
-  static bool IsValidWord(std::string_view word);
 
-  std::vector<std::string_view> SplitIntoWordsNoStop(
-      std::string_view text) const;
+  WordCounts ComputeWordCounts(std::string_view text) const;
+  void EraseFingerprint(int document_id);
+  // Whether an indexed document has the words of word_counts; fingerprints
+  // only narrow down the documents compared.
+  bool HasIndexedDuplicate(const WordCounts& word_counts) const;
+  static bool HaveSameWords(const WordCounts& lhs, const WordCounts& rhs);
+
+  template <typename ExecutionPolicy>
+  IndexingStats AddDocumentsBatch(ExecutionPolicy&& policy,
+                                  const std::vector<DocumentToAdd>& documents,
+                                  size_t slice_count);
 
   static int ComputeAverageRating(const std::vector<int>& ratings);
 
-  struct QueryWord {
-    std::string_view data;
-    bool is_minus;
-    bool is_stop;
-  };
+  // Takes a free ordinal for document_id, or a new one if none is free.
+  int AssignOrdinal(int document_id);
+  void ReleaseOrdinal(int document_id);
+  const DocumentData& GetDocumentData(int document_id) const;
 
-  QueryWord ParseQueryWord(std::string_view& text) const;
+  TermQuery ParseQuery(std::string_view text) const;
 
-  struct Query {
-    std::vector<std::string_view> plus_words;
-    std::vector<std::string_view> minus_words;
+  // Postings of a query term together with its inverse document frequency.
+  struct TermHandle {
+    const PostingList* postings = nullptr;
+    double inverse_document_freq = 0.0;
   };
 
-  Query ParseQuery(std::string_view& text) const;
-
-  double ComputeWordInverseDocumentFreq(std::string_view& word) const;
+  TermHandle GetTermHandle(InvertedIndex::TermId term_id) const;
+  // The plus term at position plus_term of query, with its weight in query.
+  TermHandle GetTermHandle(const TermQuery& query, size_t plus_term) const;
+  // Replaces the weights of the query terms with the ones stats give them.
+  void ApplyCollectionStats(const CollectionStats& stats,
+                            TermQuery& query) const;
+  void OnDocumentCountChanged();
 
   template <typename DocumentPredicate>
-  std::vector<Document> FindAllDocuments(
-      const Query& query, DocumentPredicate document_predicate) const;
+  std::vector<Document> FindAllDocuments(const TermQuery& query,
+                                         DocumentPredicate document_predicate,
+                                         size_t max_result_count) const;
   template <typename DocumentPredicate>
   std::vector<Document> FindAllDocuments(
-      const std::execution::sequenced_policy&, const Query& query,
-      DocumentPredicate document_predicate) const;
+      const std::execution::sequenced_policy&, const TermQuery& query,
+      DocumentPredicate document_predicate, size_t max_result_count) const;
   template <typename DocumentPredicate>
   std::vector<Document> FindAllDocuments(
-      const std::execution::parallel_policy&, const Query& query,
-      DocumentPredicate document_predicate) const;
+      const std::execution::parallel_policy&, const TermQuery& query,
+      DocumentPredicate document_predicate, size_t max_result_count) const;
+  template <typename ExecutionPolicy>
+  std::vector<std::vector<Document>> FindTopDocumentsInGroups(
+      ExecutionPolicy&& policy,
+      const std::vector<std::string_view>& raw_queries,
+      DocumentStatus status, size_t max_result_count) const;
+  std::vector<std::vector<Document>> FindGroupTopDocuments(
+      const std::vector<const TermQuery*>& queries, DocumentStatus status,
+      size_t max_result_count) const;
+  template <typename DocumentPredicate>
+  std::vector<Document> FindAllDocumentsBlockMaxWand(
+      const TermQuery& query, DocumentPredicate document_predicate,
+      size_t max_result_count) const;
 };
 
 template <typename StringContainer>
@@ -143,42 +375,58 @@ SearchServer::SearchServer(const StringContainer& stop_words)
 
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(
-    std::string_view raw_query, DocumentPredicate document_predicate) const {
-  return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+    std::string_view raw_query, DocumentPredicate document_predicate,
+    size_t max_result_count) const {
+  return FindTopDocuments(std::execution::seq, raw_query, document_predicate,
+                          max_result_count);
 }
 
 template <typename ExecutionPolicy, typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(
     ExecutionPolicy&& policy, std::string_view raw_query,
-    DocumentPredicate document_predicate) const {
+    DocumentPredicate document_predicate, size_t max_result_count) const {
+  QUERY_METRICS(metrics, *metrics_);
+  QUERY_METRICS_ADD(metrics, QueryCounter::QUERIES, 1);
   const auto query = ParseQuery(raw_query);
-  auto matched_documents = FindAllDocuments(policy, query, document_predicate);
-
-  sort(policy, matched_documents.begin(), matched_documents.end(),
-       [this](const Document& lhs, const Document& rhs) {
-         if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
-           return lhs.rating > rhs.rating;
-         } else {
-           return lhs.relevance > rhs.relevance;
-         }
-       });
-
-  if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-    matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-  }
+  return FindAllDocuments(policy, query, document_predicate, max_result_count);
+}
 
-  return matched_documents;
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(
+    std::string_view raw_query, const CollectionStats& stats,
+    DocumentPredicate document_predicate, size_t max_result_count) const {
+  QUERY_METRICS(metrics, *metrics_);
+  QUERY_METRICS_ADD(metrics, QueryCounter::QUERIES, 1);
+  auto query = ParseQuery(raw_query);
+  ApplyCollectionStats(stats, query);
+  return FindAllDocuments(query, document_predicate, max_result_count);
 }
 
 template <typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(
     ExecutionPolicy&& policy, std::string_view raw_query,
-    DocumentStatus status) const {
-  return FindTopDocuments(
-      policy, raw_query,
-      [&status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status;
-      });
+    DocumentStatus status, size_t max_result_count) const {
+  QUERY_METRICS(metrics, *metrics_);
+  QUERY_METRICS_ADD(metrics, QueryCounter::QUERIES, 1);
+  const auto query = ParseQuery(raw_query);
+  const auto document_predicate = [&status](int document_id,
+                                            DocumentStatus document_status,
+                                            int rating) {
+    return document_status == status;
+  };
+  if (!query_cache_) {
+    return FindAllDocuments(policy, query, document_predicate,
+                            max_result_count);
+  }
+
+  QueryCache::Key key{query, status, max_result_count};
+  std::vector<Document> result;
+  if (!query_cache_->Find(key, generation_, result)) {
+    result =
+        FindAllDocuments(policy, query, document_predicate, max_result_count);
+    query_cache_->Insert(std::move(key), generation_, result);
+  }
+  return result;
 }
 
 template <typename ExecutionPolicy>
@@ -187,97 +435,373 @@ std::vector<Document> SearchServer::FindTopDocuments(
   return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
+template <typename Handler>
+void SearchServer::ForEachDocumentWord(int document_id, Handler handler) const {
+  const auto helper = ids_of_docs_to_term_counts_.find(document_id);
+  if (helper != ids_of_docs_to_term_counts_.end()) {
+    for (const auto& [term_id, count] : helper->second) {
+      handler(index_.GetTerm(term_id));
+    }
+  }
+}
+
+template <typename DocumentIds>
+void SearchServer::RemoveDocuments(const DocumentIds& document_ids) {
+  RemoveDocuments(std::execution::seq, document_ids);
+}
+
+// Collects the postings to erase per term first, so every posting list is
+// compacted once however many of the documents contain the term.
+template <typename ExecutionPolicy, typename DocumentIds>
+void SearchServer::RemoveDocuments(ExecutionPolicy&& policy,
+                                   const DocumentIds& document_ids) {
+  std::vector<int> removed_ids;
+  for (const int document_id : document_ids) {
+    if (document_ids_.count(document_id) > 0) {
+      removed_ids.push_back(document_id);
+    }
+  }
+  std::sort(removed_ids.begin(), removed_ids.end());
+  removed_ids.erase(std::unique(removed_ids.begin(), removed_ids.end()),
+                    removed_ids.end());
+
+  // Posting lists want the ordinals to erase in ascending order.
+  std::vector<std::pair<int, int>> removed_ordinals;
+  removed_ordinals.reserve(removed_ids.size());
+  for (const int document_id : removed_ids) {
+    removed_ordinals.emplace_back(document_ordinals_.at(document_id),
+                                  document_id);
+  }
+  std::sort(removed_ordinals.begin(), removed_ordinals.end());
+
+  std::unordered_map<InvertedIndex::TermId, std::vector<int>> removals_by_term;
+  for (const auto& [ordinal, document_id] : removed_ordinals) {
+    const auto& term_counts = ids_of_docs_to_term_counts_.at(document_id);
+    for (const auto& [term_id, _] : term_counts) {
+      removals_by_term[term_id].push_back(ordinal);
+    }
+  }
+  index_.ErasePostings(
+      SelectThreadPool(policy),
+      std::vector<InvertedIndex::Removal>(
+          std::make_move_iterator(removals_by_term.begin()),
+          std::make_move_iterator(removals_by_term.end())));
+
+  for (const int document_id : removed_ids) {
+    document_ids_.erase(document_id);
+    ids_of_docs_to_term_counts_.erase(document_id);
+    texts_.Erase(GetDocumentData(document_id).text_id);
+    EraseFingerprint(document_id);
+    ReleaseOrdinal(document_id);
+  }
+  if (!removed_ids.empty()) {
+    texts_.Compact();
+    OnDocumentCountChanged();
+  }
+}
+
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindAllDocuments(
-    const Query& query, DocumentPredicate document_predicate) const {
-  return FindAllDocuments(std::execution::seq, query, document_predicate);
+    const TermQuery& query, DocumentPredicate document_predicate,
+    size_t max_result_count) const {
+  return FindAllDocuments(std::execution::seq, query, document_predicate,
+                          max_result_count);
 }
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindAllDocuments(
-    const std::execution::sequenced_policy&, const Query& query,
-    DocumentPredicate document_predicate) const {
-  std::map<int, double> document_to_relevance;
+    const std::execution::sequenced_policy&, const TermQuery& query,
+    DocumentPredicate document_predicate, size_t max_result_count) const {
+  if (query_evaluation_ == QueryEvaluation::BLOCK_MAX_WAND) {
+    return FindAllDocumentsBlockMaxWand(query, document_predicate,
+                                        max_result_count);
+  }
 
-  for (std::string_view word : query.plus_words) {
-    if (word_to_document_freqs_.count(word) == 0) {
-      continue;
-    }
-    const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-    for (const auto [document_id, term_freq] :
-         word_to_document_freqs_.at(word)) {
-      const auto& document_data = documents_.at(document_id);
-      if (document_predicate(document_id, document_data.status,
+  QUERY_METRICS(metrics, *metrics_);
+  ScoreAccumulator::Lease accumulator(document_data_.size());
+
+  for (const auto term_id : query.minus_terms) {
+    const PostingList& postings = index_.GetPostings(term_id);
+    QUERY_METRICS_ADD(metrics, QueryCounter::POSTINGS_SCANNED,
+                      postings.Size());
+    postings.ForEach(
+        [&](int ordinal, uint32_t) { accumulator->Exclude(ordinal); });
+  }
+  QUERY_METRICS_LAP(metrics, QueryStage::MINUS_FILTER);
+
+  for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+    const auto [postings, inverse_document_freq] = GetTermHandle(query, i);
+    QUERY_METRICS_ADD(metrics, QueryCounter::POSTINGS_SCANNED,
+                      postings->Size());
+    postings->ForEach([&](int ordinal, uint32_t count) {
+      if (accumulator->IsExcluded(ordinal)) {
+        return;
+      }
+      const DocumentData& document_data = document_data_[ordinal];
+      if (document_predicate(document_data.id, document_data.status,
                              document_data.rating)) {
-        document_to_relevance[document_id] += term_freq * inverse_document_freq;
+        accumulator->Add(ordinal, count * document_data.inv_word_count *
+                                      inverse_document_freq);
       }
+    });
+  }
+  QUERY_METRICS_ADD(metrics, QueryCounter::CANDIDATES,
+                    accumulator->GetTouched().size());
+  QUERY_METRICS_LAP(metrics, QueryStage::SCORE);
+
+  TopDocuments top(max_result_count);
+  for (const int ordinal : accumulator->GetTouched()) {
+    if (!accumulator->IsExcluded(ordinal)) {
+      const DocumentData& document_data = document_data_[ordinal];
+      top.Add({document_data.id, accumulator->GetRelevance(ordinal),
+               document_data.rating});
     }
   }
+  QUERY_METRICS_LAP(metrics, QueryStage::TOP_K);
+
+  auto result = top.Extract();
+  QUERY_METRICS_LAP(metrics, QueryStage::SORT);
+  return result;
+}
+
+// The range of document ordinals is cut into slices, one per thread. Each
+// thread scores its part of every posting list into its own accumulator and
+// keeps its own top, so nothing is shared until the tops are merged.
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindAllDocuments(
+    const std::execution::parallel_policy&, const TermQuery& query,
+    DocumentPredicate document_predicate, size_t max_result_count) const {
+  const size_t MIN_POSTINGS_PER_SLICE = 16384;
+
+  std::vector<TermHandle> plus_postings;
+  size_t posting_count = 0;
+  for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+    plus_postings.push_back(GetTermHandle(query, i));
+    posting_count += plus_postings.back().postings->Size();
+  }
+
+  std::vector<const PostingList*> minus_postings;
+  size_t scanned_count = posting_count;
+  for (const auto term_id : query.minus_terms) {
+    minus_postings.push_back(&index_.GetPostings(term_id));
+    scanned_count += minus_postings.back()->Size();
+  }
+
+  const size_t slice_count = std::min(thread_pool_->GetConcurrency(),
+                                      posting_count / MIN_POSTINGS_PER_SLICE);
+  if (slice_count <= 1) {
+    return FindAllDocuments(std::execution::seq, query, document_predicate,
+                            max_result_count);
+  }
 
-  for (const auto word : query.minus_words) {
-    if (word_to_document_freqs_.count(word) == 0) {
-      continue;
+  QUERY_METRICS(metrics, *metrics_);
+  QUERY_METRICS_ADD(metrics, QueryCounter::POSTINGS_SCANNED, scanned_count);
+  std::vector<TopDocuments> slice_tops(slice_count,
+                                       TopDocuments(max_result_count));
+  thread_pool_->ParallelFor(slice_count, 1, [&](size_t slice) {
+    const int first_ordinal =
+        static_cast<int>(document_data_.size() * slice / slice_count);
+    const int last_ordinal =
+        static_cast<int>(document_data_.size() * (slice + 1) / slice_count);
+    ScoreAccumulator::Lease accumulator(document_data_.size());
+
+    for (const PostingList* postings : minus_postings) {
+      postings->ForEachInRange(
+          first_ordinal, last_ordinal,
+          [&](int ordinal, uint32_t) { accumulator->Exclude(ordinal); });
     }
-    for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-      document_to_relevance.erase(document_id);
+
+    for (const auto [postings, inverse_document_freq] : plus_postings) {
+      postings->ForEachInRange(
+          first_ordinal, last_ordinal, [&](int ordinal, uint32_t count) {
+            if (accumulator->IsExcluded(ordinal)) {
+              return;
+            }
+            const DocumentData& document_data = document_data_[ordinal];
+            if (document_predicate(document_data.id, document_data.status,
+                                   document_data.rating)) {
+              accumulator->Add(ordinal, count * document_data.inv_word_count *
+                                            inverse_document_freq);
+            }
+          });
     }
-  }
 
-  std::vector<Document> matched_documents;
-  for (const auto [document_id, relevance] : document_to_relevance) {
-    matched_documents.push_back(
-        {document_id, relevance, documents_.at(document_id).rating});
+    for (const int ordinal : accumulator->GetTouched()) {
+      if (!accumulator->IsExcluded(ordinal)) {
+        const DocumentData& document_data = document_data_[ordinal];
+        slice_tops[slice].Add({document_data.id,
+                               accumulator->GetRelevance(ordinal),
+                               document_data.rating});
+      }
+    }
+    QUERY_METRICS(slice_metrics, *metrics_);
+    QUERY_METRICS_ADD(slice_metrics, QueryCounter::CANDIDATES,
+                      accumulator->GetTouched().size());
+  });
+  QUERY_METRICS_LAP(metrics, QueryStage::SCORE);
+
+  TopDocuments top(max_result_count);
+  for (const TopDocuments& slice_top : slice_tops) {
+    top.Merge(slice_top);
   }
+  QUERY_METRICS_LAP(metrics, QueryStage::TOP_K);
 
-  return matched_documents;
+  auto result = top.Extract();
+  QUERY_METRICS_LAP(metrics, QueryStage::SORT);
+  return result;
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(
-    const std::execution::parallel_policy&, const Query& query,
-    DocumentPredicate document_predicate) const {
-  const int BUCKET_COUNT = 101;
-  ConcurrentMap<int, double> document_to_relevance(BUCKET_COUNT);
-
-  const auto plus_func = [this, &document_predicate,
-                          &document_to_relevance](std::string_view word) {
-    if (word_to_document_freqs_.count(word) == 0) {  //
-      return;
+std::vector<Document> SearchServer::FindAllDocumentsBlockMaxWand(
+    const TermQuery& query, DocumentPredicate document_predicate,
+    size_t max_result_count) const {
+  constexpr int NO_DOCUMENT = std::numeric_limits<int>::max();
+
+  // Cursors are positioned at document ordinals. An ended cursor reports
+  // NO_DOCUMENT and sorts after all others.
+  struct TermCursor {
+    PostingList::Cursor cursor;
+    double inverse_document_freq;
+    double max_relevance;
+    int document_id;
+
+    void Sync() {
+      document_id = cursor.IsEnd() ? NO_DOCUMENT : cursor.DocumentId();
     }
-    const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-    for (const auto& [document_id, term_freq] :
-         word_to_document_freqs_.at(word)) {
-      const auto& document_data = documents_.at(document_id);  //
-      if (document_predicate(document_id, document_data.status,
-                             document_data.rating)) {
-        document_to_relevance[document_id].ref_to_value +=
-            term_freq * inverse_document_freq;
-      }
+    void Next() {
+      cursor.Next();
+      Sync();
+    }
+    void SkipTo(int target_document_id) {
+      cursor.SkipTo(target_document_id);
+      Sync();
     }
   };
 
-  for_each(std::execution::par, query.plus_words.begin(),
-           query.plus_words.end(), plus_func);
+  TopDocuments top(max_result_count);
+  if (max_result_count == 0) {
+    return top.Extract();
+  }
+  QUERY_METRICS(metrics, *metrics_);
+
+  // Kept in query order, so relevance is summed exactly as in the
+  // term-at-a-time path.
+  std::vector<TermCursor> cursors;
+  for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+    const auto [postings, inverse_document_freq] = GetTermHandle(query, i);
+    cursors.push_back({PostingList::Cursor(*postings), inverse_document_freq,
+                       postings->GetMaxTermFreq() * inverse_document_freq,
+                       NO_DOCUMENT});
+    cursors.back().Sync();
+  }
 
-  const auto minus_erase_func = [&](std::string_view word) {
-    if (word_to_document_freqs_.count(word) == 0) {
-      return;
-    }
-    for (const auto& [document_id, _] : word_to_document_freqs_.at(word)) {
-      document_to_relevance.erase(document_id);
+  std::vector<PostingList::Cursor> minus_cursors;
+  for (const auto term_id : query.minus_terms) {
+    minus_cursors.emplace_back(index_.GetPostings(term_id));
+  }
+
+  const auto is_excluded = [&minus_cursors](int document_id) {
+    for (PostingList::Cursor& cursor : minus_cursors) {
+      cursor.SkipTo(document_id);
+      if (!cursor.IsEnd() && cursor.DocumentId() == document_id) {
+        return true;
+      }
     }
+    return false;
   };
 
-  for_each(std::execution::par, query.minus_words.begin(),
-           query.minus_words.end(), minus_erase_func);
+  std::vector<TermCursor*> order;
+  for (TermCursor& cursor : cursors) {
+    order.push_back(&cursor);
+  }
+  const auto by_document_id = [](const TermCursor* lhs,
+                                 const TermCursor* rhs) {
+    return lhs->document_id < rhs->document_id;
+  };
+  std::sort(order.begin(), order.end(), by_document_id);
+
+  while (!order.empty() && order.front()->document_id != NO_DOCUMENT) {
+    // A document can only enter the top if it beats the worst kept one by
+    // more than EPSILON; the extra EPSILON absorbs rounding in the bounds.
+    const double threshold =
+        top.IsFull() ? top.Worst().relevance - 2 * TopDocuments::EPSILON
+                     : -std::numeric_limits<double>::infinity();
+
+    size_t pivot = 0;
+    double bound = 0.0;
+    for (; pivot < order.size() && order[pivot]->document_id != NO_DOCUMENT;
+         ++pivot) {
+      bound += order[pivot]->max_relevance;
+      if (bound > threshold) {
+        break;
+      }
+    }
+    if (pivot == order.size() || order[pivot]->document_id == NO_DOCUMENT) {
+      break;
+    }
 
-  const auto& document_to_relevance_bom =
-      document_to_relevance.BuildOrdinaryMap();
+    const int pivot_document_id = order[pivot]->document_id;
+    while (pivot + 1 < order.size() &&
+           order[pivot + 1]->document_id == pivot_document_id) {
+      ++pivot;
+    }
 
-  std::vector<Document> matched_documents;
-  for (const auto& [document_id, relevance] : document_to_relevance_bom) {
-    matched_documents.push_back(
-        {document_id, relevance, documents_.at(document_id).rating});
+    double block_bound = 0.0;
+    int next_document_id =
+        pivot + 1 < order.size() ? order[pivot + 1]->document_id : NO_DOCUMENT;
+    for (size_t i = 0; i <= pivot; ++i) {
+      PostingList::Cursor& cursor = order[i]->cursor;
+      cursor.ShallowSkipTo(pivot_document_id);
+      block_bound +=
+          cursor.BlockMaxTermFreq() * order[i]->inverse_document_freq;
+      const int block_last_document_id = cursor.BlockLastDocumentId();
+      if (block_last_document_id < next_document_id) {
+        next_document_id = block_last_document_id + 1;
+      }
+    }
+
+    if (block_bound <= threshold) {
+      for (size_t i = 0; i <= pivot; ++i) {
+        order[i]->SkipTo(next_document_id);
+      }
+    } else if (order.front()->document_id != pivot_document_id) {
+      for (size_t i = 0; i < pivot; ++i) {
+        order[i]->SkipTo(pivot_document_id);
+      }
+    } else {
+      const DocumentData& document_data = document_data_[pivot_document_id];
+      if (!is_excluded(pivot_document_id) &&
+          document_predicate(document_data.id, document_data.status,
+                             document_data.rating)) {
+        double relevance = 0.0;
+        for (const TermCursor& cursor : cursors) {
+          if (cursor.document_id == pivot_document_id) {
+            relevance += cursor.cursor.Count() *
+                         document_data.inv_word_count *
+                         cursor.inverse_document_freq;
+          }
+        }
+        top.Add({document_data.id, relevance, document_data.rating});
+      }
+      QUERY_METRICS_ADD(metrics, QueryCounter::POSTINGS_SCANNED, pivot + 1);
+      QUERY_METRICS_ADD(metrics, QueryCounter::CANDIDATES, 1);
+      for (size_t i = 0; i <= pivot; ++i) {
+        order[i]->Next();
+      }
+    }
+
+    // Only the cursors up to the pivot have moved, re-insert them.
+    for (size_t i = pivot + 1; i-- > 0;) {
+      for (size_t j = i; j + 1 < order.size() &&
+                         by_document_id(order[j + 1], order[j]);
+           ++j) {
+        std::swap(order[j], order[j + 1]);
+      }
+    }
   }
 
-  return matched_documents;
-}
\ No newline at end of file
+  QUERY_METRICS_LAP(metrics, QueryStage::SCORE);
+
+  auto result = top.Extract();
+  QUERY_METRICS_LAP(metrics, QueryStage::SORT);
+  return result;
+}
@@ -0,0 +1,83 @@
+﻿#include "sharded_search_server.h"
+
+CollectionStats ComputeCollectionStats(const std::vector<CollectionPart>& parts,
+                                       std::string_view raw_query) {
+  // Stop words are not in any dictionary, so they need not be left out.
+  const Query query =
+      ParseQuery(raw_query, [](std::string_view) { return false; });
+
+  CollectionStats stats;
+  for (const CollectionPart& part : parts) {
+    stats.document_count += part.server->GetDocumentCount();
+    if (part.tombstones) {
+      stats.document_count -= static_cast<int>(part.tombstones->Size());
+    }
+  }
+  for (const std::string_view word : query.plus_words) {
+    int document_freq = 0;
+    for (const CollectionPart& part : parts) {
+      document_freq += part.server->GetDocumentFreq(word);
+      if (part.tombstones) {
+        document_freq -= part.tombstones->GetDocumentFreq(word);
+      }
+    }
+    stats.document_freqs.emplace(word, document_freq);
+  }
+  return stats;
+}
+
+void ShardedSearchServer::AddDocument(int document_id,
+                                      std::string_view document,
+                                      DocumentStatus status,
+                                      const std::vector<int>& ratings) {
+  shards_[GetShardIndex(document_id)]->AddDocument(document_id, document,
+                                                   status, ratings);
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+  shards_[GetShardIndex(document_id)]->RemoveDocument(document_id);
+}
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(
+    std::string_view raw_query, DocumentStatus status,
+    size_t max_result_count) const {
+  return FindTopDocuments(
+      raw_query,
+      [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+      },
+      max_result_count);
+}
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(
+    std::string_view raw_query) const {
+  return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus>
+ShardedSearchServer::MatchDocument(std::string_view raw_query,
+                                   int document_id) const {
+  return shards_[GetShardIndex(document_id)]->MatchDocument(raw_query,
+                                                            document_id);
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+  int document_count = 0;
+  for (const auto& shard : shards_) {
+    document_count += shard->GetDocumentCount();
+  }
+  return document_count;
+}
+
+size_t ShardedSearchServer::GetShardCount() const { return shards_.size(); }
+
+const SearchServer& ShardedSearchServer::GetShard(size_t shard) const {
+  return *shards_.at(shard);
+}
+
+size_t ShardedSearchServer::GetShardIndex(int document_id) const {
+  // Multiplicative hashing spreads runs of consecutive ids over all shards.
+  const uint64_t hash =
+      static_cast<uint32_t>(document_id) * 0x9E3779B97F4A7C15ull;
+  return static_cast<size_t>(hash >> 32) % shards_.size();
+}
@@ -0,0 +1,120 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <execution>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "search_server.h"
+#include "tombstones.h"
+
+// One of several servers that hold disjoint parts of a collection.
+struct CollectionPart {
+  const SearchServer* server = nullptr;
+  // Documents of the server that count as removed, or nullptr.
+  const Tombstones* tombstones = nullptr;
+};
+
+// Document count of the collection and document frequencies of the plus
+// words of raw_query, summed over its parts. Throws for invalid queries.
+CollectionStats ComputeCollectionStats(const std::vector<CollectionPart>& parts,
+                                       std::string_view raw_query);
+
+// Runs the query on all parts in parallel, every one of them ranking with
+// the statistics of the whole collection, and merges their tops. The result
+// is that of one server holding all the documents, up to rounding in the
+// last bits of the relevances. The parts run on the thread pool of the first
+// one.
+template <typename DocumentPredicate>
+std::vector<Document> FindTopDocumentsInCollection(
+    const std::vector<CollectionPart>& parts, std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t max_result_count) {
+  const CollectionStats stats = ComputeCollectionStats(parts, raw_query);
+
+  std::vector<std::vector<Document>> part_tops(parts.size());
+  if (!parts.empty()) {
+    parts.front().server->GetThreadPool()->ParallelFor(
+        parts.size(), 1, [&](size_t i) {
+          const CollectionPart& part = parts[i];
+          part_tops[i] = part.server->FindTopDocuments(
+              raw_query, stats,
+              [&](int document_id, DocumentStatus status, int rating) {
+                return !(part.tombstones &&
+                         part.tombstones->Contains(document_id)) &&
+                       document_predicate(document_id, status, rating);
+              },
+              max_result_count);
+        });
+  }
+
+  TopDocuments top(max_result_count);
+  for (const auto& part_top : part_tops) {
+    for (const Document& document : part_top) {
+      top.Add(document);
+    }
+  }
+  return top.Extract();
+}
+
+// Splits documents between shard_count SearchServer shards by a hash of their
+// ids. Queries run on all shards in parallel with the document frequencies
+// of the whole collection, see FindTopDocumentsInCollection.
+class ShardedSearchServer {
+ public:
+  template <typename StringContainer>
+  ShardedSearchServer(const StringContainer& stop_words, size_t shard_count);
+  ShardedSearchServer(const std::string& stop_words_text, size_t shard_count)
+      : ShardedSearchServer(SplitIntoWords(stop_words_text), shard_count) {}
+
+  void AddDocument(int document_id, std::string_view document,
+                   DocumentStatus status, const std::vector<int>& ratings);
+  void RemoveDocument(int document_id);
+
+  template <typename DocumentPredicate>
+  std::vector<Document> FindTopDocuments(
+      std::string_view raw_query, DocumentPredicate document_predicate,
+      size_t max_result_count = SearchServer::MAX_RESULT_DOCUMENT_COUNT) const;
+  std::vector<Document> FindTopDocuments(
+      std::string_view raw_query, DocumentStatus status,
+      size_t max_result_count = SearchServer::MAX_RESULT_DOCUMENT_COUNT) const;
+  std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+  std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(
+      std::string_view raw_query, int document_id) const;
+
+  int GetDocumentCount() const;
+  size_t GetShardCount() const;
+  const SearchServer& GetShard(size_t shard) const;
+
+ private:
+  // SearchServer can be neither copied nor moved.
+  std::vector<std::unique_ptr<SearchServer>> shards_;
+  std::vector<CollectionPart> shard_parts_;
+
+  size_t GetShardIndex(int document_id) const;
+};
+
+template <typename StringContainer>
+ShardedSearchServer::ShardedSearchServer(const StringContainer& stop_words,
+                                         size_t shard_count) {
+  if (shard_count == 0) {
+    throw std::invalid_argument("Shard count must be positive"s);
+  }
+  const auto unique_stop_words = MakeUniqueNonEmptyStrings(stop_words);
+  for (size_t shard = 0; shard < shard_count; ++shard) {
+    shards_.push_back(std::make_unique<SearchServer>(unique_stop_words));
+    shard_parts_.push_back({shards_.back().get(), nullptr});
+  }
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(
+    std::string_view raw_query, DocumentPredicate document_predicate,
+    size_t max_result_count) const {
+  return FindTopDocumentsInCollection(shard_parts_, raw_query,
+                                      document_predicate, max_result_count);
+}
@@ -1,20 +1,128 @@
 ﻿#include "string_processing.h"
- 
-std::vector<std::string_view> SplitIntoWords(std::string_view text) {
-    
-    std::string_view delimiter = " "; 
-    std::vector<std::string_view> words;
- 
-    int64_t start_pos = text.find_first_not_of(delimiter);
-    const int64_t end_pos = text.npos;
- 
-    while (start_pos != end_pos) {
-        int64_t space = text.find(' ', start_pos);
-        words.push_back(space == end_pos 
-                        ? text.substr(start_pos)
-                        : text.substr(start_pos, space - start_pos));
-        start_pos = text.find_first_not_of(delimiter, space);
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STRING_PROCESSING_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+constexpr size_t SCAN_WIDTH = 16;
+
+struct ScanMasks {
+  uint32_t spaces = 0;
+  uint32_t control_chars = 0;
+};
+
+// Bit i of the masks describes data[i]; size is at most SCAN_WIDTH.
+ScanMasks Scan(const char* data, size_t size) {
+  ScanMasks masks;
+#ifdef STRING_PROCESSING_SSE2
+  if (size == SCAN_WIDTH) {
+    const __m128i chars =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    const __m128i spaces = _mm_cmpeq_epi8(chars, _mm_set1_epi8(' '));
+    // Bytes 0..31 are exactly those left unchanged by an unsigned min with
+    // 31.
+    const __m128i control_chars =
+        _mm_cmpeq_epi8(_mm_min_epu8(chars, _mm_set1_epi8(' ' - 1)), chars);
+    masks.spaces = static_cast<uint32_t>(_mm_movemask_epi8(spaces));
+    masks.control_chars =
+        static_cast<uint32_t>(_mm_movemask_epi8(control_chars));
+    return masks;
+  }
+#endif
+  for (size_t i = 0; i < size; ++i) {
+    const auto c = static_cast<unsigned char>(data[i]);
+    masks.spaces |= static_cast<uint32_t>(c == ' ') << i;
+    masks.control_chars |= static_cast<uint32_t>(c < ' ') << i;
+  }
+  return masks;
+}
+
+// mask must not be zero.
+int CountTrailingZeros(uint32_t mask) {
+#if defined(_MSC_VER)
+  unsigned long index = 0;
+  _BitScanForward(&index, mask);
+  return static_cast<int>(index);
+#elif defined(__GNUC__)
+  return __builtin_ctz(mask);
+#else
+  int count = 0;
+  while ((mask & 1) == 0) {
+    mask >>= 1;
+    ++count;
+  }
+  return count;
+#endif
+}
+
+}  // namespace
+
+bool WordTokenizer::Next(std::string_view& word, bool& is_valid) {
+  while (pos_ < text_.size()) {
+    const size_t size = std::min(SCAN_WIDTH, text_.size() - pos_);
+    const uint32_t non_spaces =
+        ~Scan(text_.data() + pos_, size).spaces & ((1u << size) - 1);
+    if (non_spaces != 0) {
+      pos_ += CountTrailingZeros(non_spaces);
+      break;
+    }
+    pos_ += size;
+  }
+  if (pos_ == text_.size()) {
+    return false;
+  }
+
+  const size_t word_start = pos_;
+  uint32_t control_chars = 0;
+  while (pos_ < text_.size()) {
+    const size_t size = std::min(SCAN_WIDTH, text_.size() - pos_);
+    const ScanMasks masks = Scan(text_.data() + pos_, size);
+    if (masks.spaces != 0) {
+      const int word_size = CountTrailingZeros(masks.spaces);
+      control_chars |= masks.control_chars & ((1u << word_size) - 1);
+      pos_ += word_size;
+      break;
     }
-    
-    return words;
-}
\ No newline at end of file
+    control_chars |= masks.control_chars;
+    pos_ += size;
+  }
+
+  word = text_.substr(word_start, pos_ - word_start);
+  is_valid = control_chars == 0;
+  return true;
+}
+
+std::vector<std::string_view> SplitIntoWords(std::string_view text) {
+  std::vector<std::string_view> words;
+  ForEachWord(text, [&words](std::string_view word, bool) {
+    words.push_back(word);
+  });
+  return words;
+}
+
+bool IsValidWord(std::string_view word) {
+  return std::none_of(word.begin(), word.end(),
+                      [](char c) { return c >= '\0' && c < ' '; });
+}
+
+uint64_t HashWord(std::string_view word) {
+  // FNV-1a, then the finalizer of splitmix64, as FNV-1a leaves the last
+  // characters poorly mixed.
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char c : word) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+  }
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+  return hash ^ (hash >> 31);
+}
@@ -1,11 +1,46 @@
 ﻿#pragma once
+#include <cstdint>
 #include <iostream>
 #include <set>
 #include <string>
+#include <string_view>
 #include <vector>
 
+// Pulls the space separated words of a text one by one without allocating.
+// Spaces and control characters are located 16 bytes at a time with SSE2
+// where it is available, and each word is reported together with whether it
+// is valid, so the text is read only once.
+class WordTokenizer {
+ public:
+  explicit WordTokenizer(std::string_view text) : text_(text) {}
+
+  // Returns false once the text is exhausted.
+  bool Next(std::string_view& word, bool& is_valid);
+
+ private:
+  std::string_view text_;
+  size_t pos_ = 0;
+};
+
+// Calls on_word(word, is_valid) for every word of text in order.
+template <typename WordHandler>
+void ForEachWord(std::string_view text, WordHandler on_word) {
+  WordTokenizer tokenizer(text);
+  std::string_view word;
+  bool is_valid = true;
+  while (tokenizer.Next(word, is_valid)) {
+    on_word(word, is_valid);
+  }
+}
+
 std::vector<std::string_view> SplitIntoWords(const std::string_view text);
 
+// A word is valid if it has no control characters.
+bool IsValidWord(std::string_view word);
+
+// 64-bit hash of a word that is the same on every platform and run.
+uint64_t HashWord(std::string_view word);
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(
     const StringContainer& strings) {
@@ -1,5 +1,26 @@
 ﻿#include "test_example_functions.h"
 
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+#include "concurrent_search_server.h"
+#include "index_file.h"
+#include "inverted_index.h"
+#include "mapped_index.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "request_queue.h"
+#include "search_metrics.h"
+#include "sharded_search_server.h"
+#include "test_framework.h"
+#include "text_arena.h"
+#include "thread_pool.h"
+
 void AddDocument(SearchServer& search_server, int document_id,
                  const std::string& document, DocumentStatus status,
                  const std::vector<int>& ratings) {
@@ -10,3 +31,1002 @@ void AddDocument(SearchServer& search_server, int document_id,
               << std::endl;
   }
 }
+
+namespace {
+
+// Words live in the dictionary, not in the documents, so removing one
+// document leaves the words and postings of the others intact whatever
+// order their ids were added in.
+void TestRemovedDocumentKeepsOtherPostings() {
+  SearchServer search_server("and"s);
+  search_server.AddDocument(3, "white cat"s, DocumentStatus::ACTUAL, {1});
+  search_server.AddDocument(1, "black cat"s, DocumentStatus::ACTUAL, {2});
+  search_server.AddDocument(2, "white dog"s, DocumentStatus::ACTUAL, {3});
+  search_server.RemoveDocument(3);
+
+  std::vector<int> found_ids;
+  for (const Document& document :
+       search_server.FindTopDocuments("white cat"s)) {
+    found_ids.push_back(document.id);
+  }
+  std::sort(found_ids.begin(), found_ids.end());
+  ASSERT_EQUAL(found_ids, (std::vector<int>{1, 2}));
+  ASSERT_EQUAL(std::get<0>(search_server.MatchDocument("white cat"s, 2)),
+               std::vector<std::string_view>{"white"});
+  ASSERT(search_server.GetWordFrequencies(3).empty());
+}
+
+// Relevances closer than EPSILON tie, and ties go to the higher rating and
+// then to the smaller id.
+void TestTopDocumentsKeepsBestRanked() {
+  TopDocuments top(3);
+  top.Add({4, 0.5, 1});
+  top.Add({7, 0.9, 0});
+  top.Add({2, 0.5 + TopDocuments::EPSILON / 2, 1});
+  top.Add({9, 0.5, 5});
+  top.Add({1, 0.1, 9});
+
+  const std::vector<Document> documents = top.Extract();
+  std::vector<int> ids;
+  for (const Document& document : documents) {
+    ids.push_back(document.id);
+  }
+  ASSERT_EQUAL(ids, (std::vector<int>{7, 9, 2}));
+}
+
+// Documents are scored by dense ordinals, so huge and sparse ids cost no
+// more than small ones, and a freed ordinal serves the next document.
+void TestSparseDocumentIds() {
+  SearchServer server("and"s);
+  server.AddDocument(INT_MAX - 1, "white cat"s, DocumentStatus::ACTUAL, {4});
+  server.AddDocument(7, "black cat"s, DocumentStatus::ACTUAL, {2});
+  server.AddDocument(1'000'000'000, "white dog"s, DocumentStatus::BANNED, {1});
+
+  auto documents = server.FindTopDocuments("white cat"s);
+  ASSERT_EQUAL(documents.size(), 2u);
+  ASSERT_EQUAL(documents[0].id, INT_MAX - 1);
+  ASSERT_EQUAL(documents[0].rating, 4);
+  ASSERT_EQUAL(documents[1].id, 7);
+
+  server.RemoveDocument(INT_MAX - 1);
+  server.AddDocument(3, "white cat"s, DocumentStatus::ACTUAL, {5});
+  documents = server.FindTopDocuments("white cat"s);
+  ASSERT_EQUAL(documents.size(), 2u);
+  ASSERT_EQUAL(documents[0].id, 3);
+  ASSERT_EQUAL(documents[1].id, 7);
+
+  const std::string query = "white -cat"s;
+  const auto [words, status] = server.MatchDocument(query, 1'000'000'000);
+  ASSERT_EQUAL(words, (std::vector<std::string_view>{"white"}));
+  ASSERT(status == DocumentStatus::BANNED);
+}
+
+// Deterministic corpus with skewed word frequencies, so that common words
+// have long posting lists spanning many blocks and rare words short ones.
+std::vector<std::string> MakeTestTexts(int document_count) {
+  std::mt19937 generator(42);
+  std::vector<std::string> texts;
+  for (int i = 0; i < document_count; ++i) {
+    std::string text;
+    const int word_count = 3 + static_cast<int>(generator() % 12);
+    for (int j = 0; j < word_count; ++j) {
+      const uint32_t word = generator() % 40 * (generator() % 40) / 40;
+      text += (j > 0 ? " w"s : "w"s) + std::to_string(word);
+    }
+    texts.push_back(std::move(text));
+  }
+  return texts;
+}
+
+// Some documents are removed and added again under other ids, so that
+// internal ordinals and document ids are not in the same order.
+template <typename Server>
+void AddTestCorpus(Server& server, int document_count) {
+  const auto texts = MakeTestTexts(document_count);
+  const auto get_status = [](int i) {
+    return i % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+  };
+  for (int i = 0; i < document_count; ++i) {
+    server.AddDocument(i * 7 + 3, texts[i], get_status(i),
+                       {i % 11, -(i % 3)});
+  }
+  for (int i = 0; i < document_count / 10; i += 3) {
+    server.RemoveDocument(i * 7 + 3);
+  }
+  for (int i = 0; i < document_count / 10; i += 3) {
+    server.AddDocument(1'000'000 - i, texts[i], get_status(i), {i % 11});
+  }
+}
+
+std::vector<std::string> MakeTestQueries() {
+  return {"w0"s,         "w1 w2"s,        "w0 w1 w39"s,     "w5 -w0"s,
+          "w3 w7 w11"s,  "w20 w30 -w1"s,  "w38 w39"s,       "w0 w1 w2 w3"s,
+          "w12 -w12"s,   "w2 w4 w6 w8"s,  "missing w9"s,    "w15 w16 -w0 -w1"s};
+}
+
+void AssertSameDocuments(const std::vector<Document>& lhs,
+                         const std::vector<Document>& rhs) {
+  ASSERT_EQUAL(lhs.size(), rhs.size());
+  for (size_t i = 0; i < lhs.size(); ++i) {
+    ASSERT_EQUAL(lhs[i].id, rhs[i].id);
+    ASSERT(std::abs(lhs[i].relevance - rhs[i].relevance) <
+           TopDocuments::EPSILON);
+    ASSERT_EQUAL(lhs[i].rating, rhs[i].rating);
+  }
+}
+
+// Block-Max WAND skips documents by score bounds but must return exactly
+// what scoring every posting returns.
+void TestBlockMaxWandMatchesExhaustive() {
+  SearchServer server("w10"s);
+  AddTestCorpus(server, 3000);
+  const auto is_even = [](int document_id, DocumentStatus, int) {
+    return document_id % 2 == 0;
+  };
+  for (const std::string& query : MakeTestQueries()) {
+    for (const size_t max_count : {size_t{1}, size_t{5}, size_t{50}}) {
+      server.SetQueryEvaluation(QueryEvaluation::TERM_AT_A_TIME);
+      const auto expected =
+          server.FindTopDocuments(query, DocumentStatus::ACTUAL, max_count);
+      const auto expected_even =
+          server.FindTopDocuments(query, is_even, max_count);
+      server.SetQueryEvaluation(QueryEvaluation::BLOCK_MAX_WAND);
+      AssertSameDocuments(
+          server.FindTopDocuments(query, DocumentStatus::ACTUAL, max_count),
+          expected);
+      AssertSameDocuments(server.FindTopDocuments(query, is_even, max_count),
+                          expected_even);
+    }
+  }
+}
+
+// Large enough for parallel queries to be cut into slices when the machine
+// has several cores; slices must not change the results.
+void TestParallelQueriesMatchSequential() {
+  SearchServer server("w10"s);
+  AddTestCorpus(server, 40000);
+  std::vector<std::string> queries = MakeTestQueries();
+  queries.push_back("w0 w1 w2 w3 w4 w5 w6 w7 -w8"s);
+  for (const std::string& query : queries) {
+    AssertSameDocuments(
+        server.FindTopDocuments(std::execution::par, query,
+                                DocumentStatus::ACTUAL, 20),
+        server.FindTopDocuments(std::execution::seq, query,
+                                DocumentStatus::ACTUAL, 20));
+  }
+}
+
+// Removing documents one by one, in a batch or in a parallel batch leaves
+// the same index as never adding them.
+void TestRemoveDocumentsMatchesRebuild() {
+  const auto texts = MakeTestTexts(600);
+  const auto is_removed = [](int i) { return i % 4 == 1 || i < 50; };
+
+  SearchServer expected("w10"s);
+  for (int i = 0; i < 600; ++i) {
+    if (!is_removed(i)) {
+      expected.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {i});
+    }
+  }
+  expected.AddDocument(1000, "unique words"s, DocumentStatus::ACTUAL, {1});
+
+  SearchServer one_by_one("w10"s);
+  SearchServer batch("w10"s);
+  SearchServer parallel_batch("w10"s);
+  std::vector<int> removed_ids;
+  for (SearchServer* server : {&one_by_one, &batch, &parallel_batch}) {
+    server->AddDocument(999, "unique words"s, DocumentStatus::ACTUAL, {1});
+    for (int i = 0; i < 600; ++i) {
+      server->AddDocument(i, texts[i], DocumentStatus::ACTUAL, {i});
+    }
+  }
+  for (int i = 599; i >= 0; --i) {
+    if (is_removed(i)) {
+      removed_ids.push_back(i);
+      one_by_one.RemoveDocument(i);
+    }
+  }
+  removed_ids.push_back(999);
+  removed_ids.push_back(12345);
+  one_by_one.RemoveDocument(999);
+  batch.RemoveDocuments(removed_ids);
+  parallel_batch.RemoveDocuments(std::execution::par, removed_ids);
+
+  for (SearchServer* server : {&one_by_one, &batch, &parallel_batch}) {
+    ASSERT(server->FindTopDocuments("unique"s).empty());
+    server->AddDocument(1000, "unique words"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(server->GetDocumentCount(), expected.GetDocumentCount());
+    for (const int document_id : removed_ids) {
+      ASSERT(server->GetWordFrequencies(document_id).empty());
+    }
+    for (const std::string& query : MakeTestQueries()) {
+      AssertSameDocuments(server->FindTopDocuments(query),
+                          expected.FindTopDocuments(query));
+    }
+    AssertSameDocuments(server->FindTopDocuments("unique"s),
+                        expected.FindTopDocuments("unique"s));
+  }
+}
+
+// A batch, sequential or parallel, indexes documents exactly as adding them
+// one by one would, also when it fills ordinals freed by removals. A batch
+// with an invalid document is rejected as a whole.
+void TestBulkAddMatchesOneByOne() {
+  const auto texts = MakeTestTexts(2000);
+  std::vector<DocumentToAdd> documents;
+  for (int i = 0; i < 2000; ++i) {
+    documents.push_back(
+        {100000 - i, texts[i], DocumentStatus::ACTUAL, {i % 7}});
+  }
+
+  SearchServer expected("w10"s);
+  SearchServer sequential("w10"s);
+  SearchServer parallel("w10"s);
+  for (SearchServer* server : {&expected, &sequential, &parallel}) {
+    AddTestCorpus(*server, 1000);
+    std::vector<int> removed_ids;
+    for (int i = 0; i < 1000; i += 2) {
+      removed_ids.push_back(i * 7 + 3);
+    }
+    server->RemoveDocuments(removed_ids);
+  }
+  for (const DocumentToAdd& document : documents) {
+    expected.AddDocument(document.id, document.text, document.status,
+                         document.ratings);
+  }
+  const IndexingStats stats = sequential.AddDocuments(documents);
+  parallel.AddDocuments(std::execution::par, documents);
+  ASSERT_EQUAL(stats.document_count, documents.size());
+
+  for (SearchServer* server : {&sequential, &parallel}) {
+    ASSERT_EQUAL(server->GetDocumentCount(), expected.GetDocumentCount());
+    for (const std::string& query : MakeTestQueries()) {
+      AssertSameDocuments(
+          server->FindTopDocuments(query, DocumentStatus::ACTUAL, 30),
+          expected.FindTopDocuments(query, DocumentStatus::ACTUAL, 30));
+    }
+    ASSERT_EQUAL(server->GetWordFrequencies(99000),
+                 expected.GetWordFrequencies(99000));
+  }
+
+  const std::vector<DocumentToAdd> invalid = {
+      {9000, "w1 w2"s, DocumentStatus::ACTUAL, {1}},
+      {9001, "w1 w\x12"s, DocumentStatus::ACTUAL, {1}}};
+  ASSERT_THROWS(sequential.AddDocuments(invalid), std::invalid_argument);
+  ASSERT(sequential.GetWordFrequencies(9000).empty());
+  ASSERT_EQUAL(sequential.GetDocumentCount(), expected.GetDocumentCount());
+}
+
+// A saved segment answers queries as the server it was saved from. Opening
+// checks only the header and the section tables, so a corrupted posting is
+// reported by the query that reads it.
+void TestSavedIndexServesSameResults() {
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "search_server_test.index")
+          .string();
+  SearchServer server("w10"s);
+  AddTestCorpus(server, 2000);
+  server.AddDocument(INT_MAX - 1, "w0 w1 w39"s, DocumentStatus::ACTUAL, {9});
+  server.SaveIndex(path);
+  // Documents are numbered densely in the file, so a huge id costs nothing.
+  ASSERT(std::filesystem::file_size(path) < 1024 * 1024);
+
+  {
+    const MappedIndex index(path);
+    ASSERT(index.VerifyChecksum());
+    ASSERT_EQUAL(index.GetDocumentCount(), server.GetDocumentCount());
+    ASSERT_EQUAL(index.GetDocumentText(INT_MAX - 1), "w0 w1 w39"s);
+    ASSERT(index.GetDocumentText(4).empty());
+    const auto is_odd = [](int document_id, DocumentStatus, int) {
+      return document_id % 2 == 1;
+    };
+    for (const std::string& query : MakeTestQueries()) {
+      AssertSameDocuments(index.FindTopDocuments(query),
+                          server.FindTopDocuments(query));
+      AssertSameDocuments(
+          index.FindTopDocuments(query, DocumentStatus::BANNED, 20),
+          server.FindTopDocuments(query, DocumentStatus::BANNED, 20));
+      AssertSameDocuments(index.FindTopDocuments(query, is_odd),
+                          server.FindTopDocuments(query, is_odd));
+    }
+  }
+
+  std::string bytes;
+  {
+    std::ifstream in(path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(in),
+                 std::istreambuf_iterator<char>());
+  }
+  const auto write_patched = [&path](std::string patched_bytes) {
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << patched_bytes;
+  };
+  IndexFileHeader header;
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  const auto section_offset = [&header](IndexFileSection section) {
+    return header.sections[static_cast<size_t>(section)].offset;
+  };
+
+  // The first posting belongs to the first term, "w0".
+  std::string patched = bytes;
+  const int32_t bad_ordinal = INT32_MAX;
+  std::memcpy(&patched[section_offset(IndexFileSection::POSTING_ORDINALS)],
+              &bad_ordinal, sizeof(bad_ordinal));
+  write_patched(patched);
+  {
+    const MappedIndex index(path);
+    ASSERT(!index.VerifyChecksum());
+    ASSERT_DOESNT_THROW(index.FindTopDocuments("w1"s));
+    ASSERT_THROWS(index.FindTopDocuments("w0"s), std::runtime_error);
+    ASSERT_THROWS(index.FindTopDocuments("w1 -w0"s), std::runtime_error);
+  }
+
+  patched = bytes;
+  int32_t ordinal = 0;
+  std::memcpy(&ordinal,
+              &bytes[section_offset(IndexFileSection::POSTING_ORDINALS)],
+              sizeof(ordinal));
+  const int32_t bad_status = 77;
+  std::memcpy(&patched[section_offset(IndexFileSection::DOCUMENT_DATA) +
+                       ordinal * sizeof(IndexFileDocumentData) +
+                       offsetof(IndexFileDocumentData, status)],
+              &bad_status, sizeof(bad_status));
+  write_patched(patched);
+  ASSERT_THROWS(MappedIndex(path).FindTopDocuments("w0"s), std::runtime_error);
+
+  patched = bytes;
+  patched[0] = 'X';
+  write_patched(patched);
+  ASSERT_THROWS(MappedIndex index(path), std::runtime_error);
+
+  std::filesystem::remove(path);
+}
+
+// Reordered and repeated words hit the same entry, and any change to the
+// index makes the cached results stale.
+void TestQueryCacheDropsStaleResults() {
+  SearchServer server("and"s);
+  server.SetQueryCacheCapacity(2);
+  server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+  server.AddDocument(2, "black dog"s, DocumentStatus::ACTUAL, {2});
+
+  ASSERT_EQUAL(server.FindTopDocuments("cat and white"s).size(), 1u);
+  ASSERT_EQUAL(server.FindTopDocuments("white cat cat"s).size(), 1u);
+  QueryCacheStats stats = server.GetQueryCacheStats();
+  ASSERT_EQUAL(stats.hit_count, 1u);
+  ASSERT_EQUAL(stats.miss_count, 1u);
+
+  server.AddDocument(3, "white dog"s, DocumentStatus::ACTUAL, {3});
+  ASSERT_EQUAL(server.FindTopDocuments("white cat"s).size(), 2u);
+  server.RemoveDocument(3);
+  auto documents = server.FindTopDocuments("white cat"s);
+  ASSERT_EQUAL(documents.size(), 1u);
+  ASSERT_EQUAL(documents[0].id, 1);
+  stats = server.GetQueryCacheStats();
+  ASSERT_EQUAL(stats.hit_count, 1u);
+  ASSERT_EQUAL(stats.miss_count, 3u);
+
+  server.FindTopDocuments("dog"s);
+  server.FindTopDocuments("black"s);
+  ASSERT_EQUAL(server.GetQueryCacheStats().eviction_count, 1u);
+  ASSERT_EQUAL(server.FindTopDocuments("white cat"s).size(), 1u);
+  ASSERT_EQUAL(server.GetQueryCacheStats().miss_count, 6u);
+}
+
+// Relevance is TF-IDF with the IDF of the current document count, which the
+// server and every posting list keep up to date as documents come and go.
+void TestRelevanceFollowsDocumentCount() {
+  SearchServer server(""s);
+  server.AddDocument(1, "white cat white tail"s, DocumentStatus::ACTUAL, {1});
+  server.AddDocument(2, "black dog"s, DocumentStatus::ACTUAL, {1});
+  server.AddDocument(3, "white dog"s, DocumentStatus::ACTUAL, {1});
+  server.AddDocument(4, "grey mouse"s, DocumentStatus::ACTUAL, {1});
+
+  auto documents = server.FindTopDocuments("white dog"s);
+  ASSERT_EQUAL(documents.size(), 3u);
+  ASSERT_EQUAL(documents[0].id, 3);
+  ASSERT(std::abs(documents[0].relevance -
+                  (0.5 * std::log(4.0 / 2) + 0.5 * std::log(4.0 / 2))) <
+         TopDocuments::EPSILON);
+  ASSERT_EQUAL(documents[1].id, 1);
+  ASSERT(std::abs(documents[1].relevance - 0.5 * std::log(4.0 / 2)) <
+         TopDocuments::EPSILON);
+
+  server.RemoveDocument(2);
+  server.RemoveDocument(4);
+  documents = server.FindTopDocuments("white dog"s);
+  ASSERT_EQUAL(documents.size(), 2u);
+  ASSERT_EQUAL(documents[0].id, 3);
+  ASSERT(std::abs(documents[0].relevance - 0.5 * std::log(2.0 / 1)) <
+         TopDocuments::EPSILON);
+  ASSERT(std::abs(documents[1].relevance) < TopDocuments::EPSILON);
+}
+
+// The vectorized tokenizer splits and validates words exactly like a plain
+// byte-by-byte loop, wherever the spaces and control characters fall
+// relative to the 16-byte steps.
+void TestTokenizerMatchesScalarSplit() {
+  std::mt19937 generator(7);
+  const std::string alphabet = "ab  z\t\x01\x7f\xc3\xa9-"s;
+  const auto is_valid_word = [](std::string_view word) {
+    return std::none_of(word.begin(), word.end(),
+                        [](char c) { return c >= '\0' && c < ' '; });
+  };
+  for (int i = 0; i < 2000; ++i) {
+    std::string text;
+    const size_t length = generator() % 70;
+    for (size_t j = 0; j < length; ++j) {
+      text += alphabet[generator() % alphabet.size()];
+    }
+
+    std::vector<std::pair<std::string_view, bool>> expected;
+    size_t start = 0;
+    for (size_t pos = 0; pos <= text.size(); ++pos) {
+      if (pos == text.size() || text[pos] == ' ') {
+        if (pos > start) {
+          const std::string_view word(text.data() + start, pos - start);
+          expected.emplace_back(word, is_valid_word(word));
+        }
+        start = pos + 1;
+      }
+    }
+
+    std::vector<std::pair<std::string_view, bool>> words;
+    ForEachWord(text, [&words](std::string_view word, bool is_valid) {
+      words.emplace_back(word, is_valid);
+    });
+    ASSERT_EQUAL(words.size(), expected.size());
+    for (size_t j = 0; j < words.size(); ++j) {
+      ASSERT_EQUAL(words[j].first, expected[j].first);
+      ASSERT_EQUAL(words[j].second, expected[j].second);
+    }
+  }
+
+  SearchServer server(""s);
+  ASSERT_THROWS(server.AddDocument(1, "cat d\x12og"s, DocumentStatus::ACTUAL,
+                                   {1}),
+                std::invalid_argument);
+  ASSERT_THROWS(server.FindTopDocuments("--cat"s), std::invalid_argument);
+  ASSERT_THROWS(server.FindTopDocuments("cat -"s), std::invalid_argument);
+}
+
+// Query words are resolved to term ids once; matching reports the words of
+// the dictionary in order, drops stop and unknown words, and a minus word
+// empties the match.
+void TestMatchDocumentByTermIds() {
+  SearchServer server("and in"s);
+  server.AddDocument(1, "cat in the city and a dog"s, DocumentStatus::BANNED,
+                     {1});
+  server.AddDocument(2, "dog"s, DocumentStatus::ACTUAL, {1});
+
+  for (const auto policy_index : {0, 1}) {
+    const auto match = [&](const std::string& query) {
+      return policy_index == 0
+                 ? server.MatchDocument(std::execution::seq, query, 1)
+                 : server.MatchDocument(std::execution::par, query, 1);
+    };
+    const auto [words, status] = match("dog and city cat unknown dog"s);
+    ASSERT_EQUAL(words,
+                 (std::vector<std::string_view>{"cat", "city", "dog"}));
+    ASSERT(status == DocumentStatus::BANNED);
+    ASSERT(std::get<0>(match("dog -the"s)).empty());
+    ASSERT(std::get<0>(match("dog -in"s)).size() == 1);
+  }
+
+  server.RemoveDocument(1);
+  ASSERT_THROWS(server.MatchDocument("dog"s, 1), std::invalid_argument);
+  server.AddDocument(1, "the city"s, DocumentStatus::ACTUAL, {1});
+  ASSERT_EQUAL(std::get<0>(server.MatchDocument("cat city dog"s, 1)),
+               (std::vector<std::string_view>{"city"}));
+}
+
+// Appends, batches that land inside the list, single and bulk erases all
+// keep the compressed blocks equal to a plain map of the postings.
+void TestPostingListMatchesReference() {
+  std::mt19937 generator(5);
+  PostingList postings;
+  std::map<int, uint32_t> reference;
+  const auto check = [&]() {
+    std::vector<std::pair<int, uint32_t>> decoded;
+    postings.ForEach([&](int document_id, uint32_t count) {
+      decoded.emplace_back(document_id, count);
+    });
+    ASSERT(decoded == (std::vector<std::pair<int, uint32_t>>(
+                          reference.begin(), reference.end())));
+    ASSERT_EQUAL(postings.Size(), reference.size());
+
+    std::vector<int> cursor_ids;
+    for (PostingList::Cursor cursor(postings); !cursor.IsEnd();
+         cursor.Next()) {
+      cursor_ids.push_back(cursor.DocumentId());
+    }
+    ASSERT_EQUAL(cursor_ids.size(), reference.size());
+  };
+
+  for (int document_id = 0; document_id < 3000; document_id += 3) {
+    const uint32_t count = 1 + generator() % 5;
+    postings.Add({document_id, count, count * 0.1});
+    reference[document_id] += count;
+  }
+  check();
+
+  std::vector<PostingList::Posting> batch;
+  for (int document_id = 1; document_id < 3000; document_id += 7) {
+    batch.push_back({document_id, 2, 0.2});
+    reference[document_id] += 2;
+  }
+  batch.push_back({2997, 1, 0.1});
+  reference[2997] += 1;
+  postings.Add(batch);
+  check();
+
+  for (int document_id = 0; document_id < 1500; ++document_id) {
+    if (generator() % 3 != 0) {
+      ASSERT_EQUAL(postings.Erase(document_id),
+                   reference.erase(document_id) > 0);
+    }
+  }
+  check();
+
+  std::vector<int> erased_ids;
+  for (int document_id = 1500; document_id < 3000; ++document_id) {
+    if (generator() % 4 != 0) {
+      erased_ids.push_back(document_id);
+    }
+  }
+  size_t erased = 0;
+  for (const int document_id : erased_ids) {
+    erased += reference.erase(document_id);
+  }
+  ASSERT_EQUAL(postings.Erase(erased_ids), erased);
+  check();
+
+  for (int document_id = 0; document_id < 3000; ++document_id) {
+    ASSERT_EQUAL(postings.Contains(document_id),
+                 reference.count(document_id) > 0);
+  }
+  // Merged blocks keep the memory close to what the postings need.
+  ASSERT(postings.GetMemoryUsage() < 8 * 1024);
+}
+
+// Compaction moves the surviving texts out of chunks that are mostly
+// garbage without changing what their ids return, and erased ids are reused.
+void TestTextArenaKeepsTextsThroughCompaction() {
+  TextArena arena;
+  std::vector<std::string> texts;
+  std::vector<TextArena::TextId> text_ids;
+  for (int i = 0; i < 2000; ++i) {
+    texts.push_back("text "s + std::to_string(i) + std::string(i % 50, 'x'));
+    text_ids.push_back(arena.Add(texts.back()));
+  }
+
+  for (size_t i = 0; i < texts.size(); ++i) {
+    if (i % 4 != 0) {
+      arena.Erase(text_ids[i]);
+    }
+  }
+  ASSERT(arena.GetGarbageSize() > arena.GetLiveSize());
+  ASSERT(arena.Compact());
+  ASSERT(arena.GetGarbageSize() < arena.GetLiveSize());
+  ASSERT(!arena.Compact());
+  for (size_t i = 0; i < texts.size(); i += 4) {
+    ASSERT_EQUAL(arena.Get(text_ids[i]), texts[i]);
+  }
+
+  const TextArena::TextId reused_id = arena.Add("new text"s);
+  ASSERT(reused_id < text_ids.size() && reused_id % 4 != 0);
+  ASSERT_EQUAL(arena.Get(reused_id), "new text"s);
+}
+
+// Queries scored together in groups, repeated queries and queries that
+// span several slices of ordinals get what each query gets alone.
+void TestBatchMatchesSingleQueries() {
+  SearchServer server("w10"s);
+  AddTestCorpus(server, 10000);
+  std::vector<std::string> queries;
+  for (int round = 0; round < 3; ++round) {
+    for (const std::string& query : MakeTestQueries()) {
+      queries.push_back(query);
+    }
+  }
+  const std::vector<std::string_view> raw_queries(queries.begin(),
+                                                  queries.end());
+
+  for (const DocumentStatus status :
+       {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+    const auto seq_results = server.FindTopDocumentsBatch(
+        std::execution::seq, raw_queries, status, 7);
+    const auto par_results = server.FindTopDocumentsBatch(
+        std::execution::par, raw_queries, status, 7);
+    ASSERT_EQUAL(seq_results.size(), queries.size());
+    ASSERT_EQUAL(par_results.size(), queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+      const auto single = server.FindTopDocuments(queries[i], status, 7);
+      AssertSameDocuments(seq_results[i], single);
+      AssertSameDocuments(par_results[i], single);
+    }
+  }
+}
+
+// The streamed range owns its queries, so it can be built from a temporary
+// and copied; across chunk borders and chunks that find nothing it yields
+// exactly the joined vector.
+void TestStreamedJoinedMatchesJoined() {
+  SearchServer server("w10"s);
+  AddTestCorpus(server, 2000);
+  const auto make_queries = []() {
+    // The whole first chunk finds nothing.
+    std::vector<std::string> queries(JoinedDocuments::CHUNK_SIZE,
+                                     "missing"s);
+    for (int i = 0; i < 500; ++i) {
+      queries.push_back("w"s + std::to_string(i % 40));
+    }
+    return queries;
+  };
+  const std::vector<Document> joined =
+      ProcessQueriesJoined(server, make_queries());
+  ASSERT(!joined.empty());
+
+  JoinedDocuments streamed = StreamQueriesJoined(server, make_queries());
+  std::vector<Document> streamed_documents;
+  auto helper = streamed.begin();
+  for (size_t i = 0; i < joined.size() / 2; ++i, ++helper) {
+    streamed_documents.push_back(*helper);
+  }
+  JoinedDocuments rest = streamed;
+  for (; helper != streamed.end(); ++helper) {
+    streamed_documents.push_back(*helper);
+  }
+  AssertSameDocuments(streamed_documents, joined);
+
+  const std::vector<Document> rest_documents(rest.begin(), rest.end());
+  AssertSameDocuments(
+      rest_documents,
+      std::vector<Document>(joined.begin() + joined.size() / 2, joined.end()));
+}
+
+// Shards rank with collection-wide document frequencies, so however the
+// documents are split the results are those of one server.
+void TestShardedMatchesSingleServer() {
+  SearchServer single("w10"s);
+  AddTestCorpus(single, 3000);
+  for (const size_t shard_count : {size_t{1}, size_t{4}, size_t{7}}) {
+    ShardedSearchServer sharded("w10"s, shard_count);
+    AddTestCorpus(sharded, 3000);
+    ASSERT_EQUAL(sharded.GetDocumentCount(), single.GetDocumentCount());
+
+    for (const std::string& query : MakeTestQueries()) {
+      AssertSameDocuments(sharded.FindTopDocuments(query),
+                          single.FindTopDocuments(query));
+      AssertSameDocuments(
+          sharded.FindTopDocuments(query, DocumentStatus::BANNED, 20),
+          single.FindTopDocuments(query, DocumentStatus::BANNED, 20));
+      const auto is_odd = [](int document_id, DocumentStatus, int) {
+        return document_id % 2 == 1;
+      };
+      AssertSameDocuments(sharded.FindTopDocuments(query, is_odd),
+                          single.FindTopDocuments(query, is_odd));
+    }
+    const std::string query = "w1 w2 -w3"s;
+    ASSERT(sharded.MatchDocument(query, 10) == single.MatchDocument(query, 10));
+    ASSERT(sharded.MatchDocument(query, 1'000'000) ==
+           single.MatchDocument(query, 1'000'000));
+  }
+}
+
+// Staged changes stay invisible until Commit, committed states match a
+// single server holding the same documents, and matched words outlive the
+// segment they were found in.
+void TestConcurrentServerPublishesOnCommit() {
+  ConcurrentSearchServer server("w10"s);
+  SearchServer reference("w10"s);
+  AddTestCorpus(server, 1000);
+  ASSERT_EQUAL(server.GetDocumentCount(), 0);
+  ASSERT(server.FindTopDocuments("w0"s).empty());
+  server.Commit();
+  AddTestCorpus(reference, 1000);
+  ASSERT_EQUAL(server.GetDocumentCount(), reference.GetDocumentCount());
+
+  const std::string match_query = "w1 w2 -w3"s;
+  const std::vector<std::string> words =
+      std::get<0>(server.MatchDocument(match_query, 10));
+  ASSERT(std::get<0>(reference.MatchDocument(match_query, 10)) ==
+         std::vector<std::string_view>(words.begin(), words.end()));
+
+  for (int document_id = 3; document_id < 7000; document_id += 14) {
+    server.RemoveDocument(document_id);
+    reference.RemoveDocument(document_id);
+  }
+  server.AddDocument(5000, "w1 w2 w2"s, DocumentStatus::ACTUAL, {4});
+  reference.AddDocument(5000, "w1 w2 w2"s, DocumentStatus::ACTUAL, {4});
+  ASSERT_EQUAL(server.GetDocumentCount(), 1000);
+  server.Commit();
+
+  // The commit may have freed the segment the words were matched in.
+  ASSERT(std::get<0>(reference.MatchDocument(match_query, 10)) ==
+         std::vector<std::string_view>(words.begin(), words.end()));
+  ASSERT_EQUAL(server.GetDocumentCount(), reference.GetDocumentCount());
+  for (const std::string& query : MakeTestQueries()) {
+    AssertSameDocuments(server.FindTopDocuments(query),
+                        reference.FindTopDocuments(query));
+  }
+}
+
+// A document removed, added anew and removed again while its second copy
+// sits in a sealed segment stays removed after the commit.
+void TestConcurrentRemoveOfReAddedDocument() {
+  ConcurrentSearchServer search_server("and"s);
+  search_server.AddDocument(5, "cat"s, DocumentStatus::ACTUAL, {1});
+  search_server.Commit();
+  search_server.RemoveDocument(5);
+  search_server.AddDocument(5, "cat"s, DocumentStatus::ACTUAL, {1});
+  for (int document_id = 100;
+       document_id < 100 + ConcurrentSearchServer::WRITE_BUFFER_SIZE;
+       ++document_id) {
+    search_server.AddDocument(document_id, "dog"s, DocumentStatus::ACTUAL,
+                              {1});
+  }
+  search_server.RemoveDocument(5);
+  search_server.Commit();
+
+  ASSERT(search_server.FindTopDocuments("cat"s).empty());
+  ASSERT_EQUAL(search_server.GetDocumentCount(),
+               ConcurrentSearchServer::WRITE_BUFFER_SIZE);
+  ASSERT_DOESNT_THROW(search_server.AddDocument(5, "cat"s,
+                                                DocumentStatus::ACTUAL, {1}));
+}
+
+// Tombstones, merges and rewrites of mostly removed segments keep the
+// ranking of one server holding the live documents, with ids far above the
+// number of documents.
+void TestMergedSegmentsMatchSingleServer() {
+  const int segment_size = ConcurrentSearchServer::WRITE_BUFFER_SIZE;
+  const int segment_count =
+      static_cast<int>(ConcurrentSearchServer::MERGE_FACTOR) + 1;
+  const int document_count = segment_size * segment_count;
+  const auto texts = MakeTestTexts(document_count);
+  ConcurrentSearchServer server("w10"s);
+  SearchServer reference("w10"s);
+  const int first_id = 20'000'000;
+  for (int i = 0; i < document_count; ++i) {
+    server.AddDocument(first_id + i, texts[i], DocumentStatus::ACTUAL,
+                       {i % 7});
+    reference.AddDocument(first_id + i, texts[i], DocumentStatus::ACTUAL,
+                          {i % 7});
+    if (i % segment_size == segment_size - 1) {
+      server.Commit();
+    }
+  }
+  // Most of the first segment goes, and a few documents of every other.
+  for (int i = 0; i < document_count; i += i < segment_size ? 2 : 97) {
+    server.RemoveDocument(first_id + i);
+    reference.RemoveDocument(first_id + i);
+  }
+  server.Commit();
+  server.WaitForMerges();
+
+  ASSERT(server.GetSegmentCount() < static_cast<size_t>(segment_count));
+  ASSERT_EQUAL(server.GetDocumentCount(), reference.GetDocumentCount());
+  for (const std::string& query : MakeTestQueries()) {
+    AssertSameDocuments(
+        server.FindTopDocuments(query, DocumentStatus::ACTUAL, 20),
+        reference.FindTopDocuments(query, DocumentStatus::ACTUAL, 20));
+  }
+}
+
+// Every index of a loop runs exactly once, also in nested loops, exceptions
+// reach the caller, and a server on its own pool answers the parallel
+// overloads like the sequential ones.
+void TestThreadPoolRunsParallelLikeSequential() {
+  const auto thread_pool = std::make_shared<ThreadPool>(3);
+  std::vector<std::atomic<int>> calls(1000);
+  thread_pool->ParallelFor(10, 1, [&](size_t i) {
+    thread_pool->ParallelFor(100, 7, [&](size_t j) { ++calls[i * 100 + j]; });
+  });
+  for (const std::atomic<int>& call_count : calls) {
+    ASSERT_EQUAL(call_count.load(), 1);
+  }
+  ASSERT_THROWS(thread_pool->ParallelFor(100, 1,
+                                         [](size_t i) {
+                                           if (i == 57) {
+                                             throw std::out_of_range("57"s);
+                                           }
+                                         }),
+                std::out_of_range);
+
+  SearchServer parallel("w10"s);
+  SearchServer sequential("w10"s);
+  parallel.SetThreadPool(thread_pool);
+  const auto texts = MakeTestTexts(20000);
+  std::vector<DocumentToAdd> documents;
+  for (int i = 0; i < 20000; ++i) {
+    documents.push_back({i, texts[i], DocumentStatus::ACTUAL, {i % 9}});
+  }
+  parallel.AddDocuments(std::execution::par, documents);
+  sequential.AddDocuments(std::execution::seq, documents);
+
+  for (const std::string& query : MakeTestQueries()) {
+    AssertSameDocuments(
+        parallel.FindTopDocuments(std::execution::par, query,
+                                  DocumentStatus::ACTUAL, 20),
+        sequential.FindTopDocuments(std::execution::seq, query,
+                                    DocumentStatus::ACTUAL, 20));
+    ASSERT(parallel.MatchDocument(std::execution::par, query, 77) ==
+           sequential.MatchDocument(std::execution::seq, query, 77));
+  }
+}
+
+// Histogram buckets are exact below 2^SUB_BUCKET_BITS and keep percentiles
+// within their resolution above. A server counts every query in builds with
+// SEARCH_SERVER_METRICS and nothing otherwise, and ResetMetrics clears it.
+void TestMetricsCountQueries() {
+  LatencyHistogram histogram;
+  for (uint64_t nanoseconds = 1; nanoseconds <= 1000; ++nanoseconds) {
+    histogram.Add(nanoseconds);
+  }
+  ASSERT_EQUAL(histogram.GetCount(), 1000u);
+  ASSERT_EQUAL(LatencyHistogram::GetBucketValue(LatencyHistogram::GetBucket(7)),
+               7u);
+  const uint64_t median = histogram.GetPercentile(0.5);
+  ASSERT(median >= 500 * 15 / 16 && median <= 500);
+  ASSERT(histogram.GetMax() >= 1000 * 15 / 16 && histogram.GetMax() <= 1000);
+
+  SearchServer server("w10"s);
+  AddTestCorpus(server, 2000);
+  server.ResetMetrics();
+  const auto queries = MakeTestQueries();
+  for (const std::string& query : queries) {
+    server.FindTopDocuments(query);
+    server.FindTopDocuments(std::execution::par, query);
+  }
+  const SearchMetricsSnapshot snapshot = server.GetMetricsSnapshot();
+#ifdef SEARCH_SERVER_METRICS
+  ASSERT_EQUAL(snapshot.Get(QueryCounter::QUERIES), 2 * queries.size());
+  ASSERT(snapshot.Get(QueryCounter::POSTINGS_SCANNED) > 0);
+  ASSERT_EQUAL(snapshot.Get(QueryStage::PARSE).GetCount(), 2 * queries.size());
+#else
+  ASSERT_EQUAL(snapshot.Get(QueryCounter::QUERIES), 0u);
+  ASSERT_EQUAL(snapshot.Get(QueryStage::PARSE).GetCount(), 0u);
+#endif
+
+  server.ResetMetrics();
+  ASSERT_EQUAL(server.GetMetricsSnapshot().Get(QueryCounter::QUERIES), 0u);
+  ASSERT_EQUAL(server.GetMetricsSnapshot().Get(QueryStage::SORT).GetCount(),
+               0u);
+}
+
+// Requests from several threads are all counted, and a request leaves the
+// statistics once the window has moved past its bucket.
+void TestRequestQueueCountsOverWindow() {
+  SearchServer server("and"s);
+  server.AddDocument(1, "fluffy cat"s, DocumentStatus::ACTUAL, {1});
+  server.AddDocument(2, "groomed dog"s, DocumentStatus::ACTUAL, {2});
+  RequestQueue request_queue(server, std::chrono::milliseconds(100), 3);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&request_queue] {
+      for (int i = 0; i < 100; ++i) {
+        request_queue.AddFindRequest(i % 4 == 0 ? "empty request"s : "cat"s);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const RequestStats stats = request_queue.GetStats(request_queue.GetWindow());
+  ASSERT_EQUAL(stats.request_count, 400u);
+  ASSERT_EQUAL(stats.no_result_count, 100u);
+  ASSERT_EQUAL(stats.latencies.GetCount(), 400u);
+  ASSERT_EQUAL(request_queue.GetNoResultRequests(), 100);
+
+  std::this_thread::sleep_for(request_queue.GetWindow() * 2);
+  ASSERT_EQUAL(request_queue.GetNoResultRequests(), 0);
+  ASSERT_EQUAL(request_queue.GetStats(request_queue.GetWindow()).request_count,
+               0u);
+  request_queue.AddFindRequest("empty request"s);
+  ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1);
+}
+
+// Word order and counts do not matter, documents whose fingerprints
+// collide are told apart by their words, and MinHash also finds exact
+// duplicates.
+void TestDuplicatesCompareWordSets() {
+  SearchServer server("and with"s);
+  server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL,
+                     {7});
+  server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL,
+                     {1});
+  server.AddDocument(3, "nasty rat funny pet rat"s, DocumentStatus::ACTUAL,
+                     {2});
+  server.AddDocument(4, "curly hair funny pet"s, DocumentStatus::ACTUAL, {3});
+  server.AddDocument(5, "very nasty rat"s, DocumentStatus::ACTUAL, {4});
+  server.AddDocument(6, "pet funny with and and hair curly"s,
+                     DocumentStatus::ACTUAL, {5});
+
+  const std::vector<int> expected = {3, 4, 6};
+  ASSERT(server.HaveSameWords(1, 3));
+  ASSERT(!server.HaveSameWords(1, 5));
+  ASSERT(!server.HaveSameWords(1, 100));
+  ASSERT(FindDuplicates(server) == expected);
+  ASSERT(FindDuplicates(std::execution::par, server) == expected);
+  ASSERT(FindNearDuplicates(server, {.min_similarity = 1.0}) == expected);
+
+  // The same fingerprint for every document.
+  std::vector<std::pair<uint64_t, int>> fingerprints;
+  for (const int document_id : server) {
+    fingerprints.emplace_back(0, document_id);
+  }
+  ASSERT(FindDuplicatesByFingerprint(server, fingerprints) == expected);
+
+  RemoveDuplicates(server);
+  ASSERT_EQUAL(server.GetDocumentCount(), 3);
+  ASSERT(FindDuplicates(server).empty());
+}
+
+// REJECT refuses documents with the words of an indexed one, or of another
+// document of the same batch, without touching the index; ALLOW indexes
+// them and FindDuplicateOf reports the smallest such id.
+void TestDuplicatePolicyComparesWords() {
+  SearchServer server("and"s);
+  server.AddDocument(4, "white cat and fancy collar"s, DocumentStatus::ACTUAL,
+                     {1});
+  server.AddDocument(7, "fancy collar white cat"s, DocumentStatus::ACTUAL, {2});
+  server.AddDocument(2, "white cat"s, DocumentStatus::ACTUAL, {3});
+  ASSERT(server.FindDuplicateOf(4) == std::optional<int>(7));
+  ASSERT(server.FindDuplicateOf(7) == std::optional<int>(4));
+  ASSERT(!server.FindDuplicateOf(2));
+  ASSERT(!server.FindDuplicateOf(100));
+
+  server.SetDuplicatePolicy(DuplicatePolicy::REJECT);
+  ASSERT_THROWS(server.AddDocument(8, "cat white cat"s, DocumentStatus::ACTUAL,
+                                   {1}),
+                std::invalid_argument);
+  ASSERT_THROWS(server.AddDocuments({{10, "black dog"s, DocumentStatus::ACTUAL,
+                                      {1}},
+                                     {11, "dog and black"s,
+                                      DocumentStatus::ACTUAL, {1}}}),
+                std::invalid_argument);
+  ASSERT_EQUAL(server.GetDocumentCount(), 3);
+  ASSERT(server.FindTopDocuments("dog"s).empty());
+
+  server.AddDocuments({{10, "black dog"s, DocumentStatus::ACTUAL, {1}},
+                       {11, "black cat"s, DocumentStatus::ACTUAL, {1}}});
+  server.AddDocument(12, "white cat collar"s, DocumentStatus::ACTUAL, {1});
+  ASSERT_EQUAL(server.GetDocumentCount(), 6);
+
+  server.RemoveDocument(2);
+  server.AddDocument(8, "cat white cat"s, DocumentStatus::ACTUAL, {1});
+  ASSERT(!server.FindDuplicateOf(8));
+  ASSERT(FindDuplicates(server) == std::vector<int>{7});
+}
+
+}  // namespace
+
+void TestSearchServer() {
+  TestRunner tr;
+  RUN_TEST(tr, TestRemovedDocumentKeepsOtherPostings);
+  RUN_TEST(tr, TestTopDocumentsKeepsBestRanked);
+  RUN_TEST(tr, TestSparseDocumentIds);
+  RUN_TEST(tr, TestBlockMaxWandMatchesExhaustive);
+  RUN_TEST(tr, TestParallelQueriesMatchSequential);
+  RUN_TEST(tr, TestRemoveDocumentsMatchesRebuild);
+  RUN_TEST(tr, TestBulkAddMatchesOneByOne);
+  RUN_TEST(tr, TestSavedIndexServesSameResults);
+  RUN_TEST(tr, TestQueryCacheDropsStaleResults);
+  RUN_TEST(tr, TestRelevanceFollowsDocumentCount);
+  RUN_TEST(tr, TestTokenizerMatchesScalarSplit);
+  RUN_TEST(tr, TestMatchDocumentByTermIds);
+  RUN_TEST(tr, TestPostingListMatchesReference);
+  RUN_TEST(tr, TestTextArenaKeepsTextsThroughCompaction);
+  RUN_TEST(tr, TestBatchMatchesSingleQueries);
+  RUN_TEST(tr, TestStreamedJoinedMatchesJoined);
+  RUN_TEST(tr, TestShardedMatchesSingleServer);
+  RUN_TEST(tr, TestConcurrentServerPublishesOnCommit);
+  RUN_TEST(tr, TestConcurrentRemoveOfReAddedDocument);
+  RUN_TEST(tr, TestMergedSegmentsMatchSingleServer);
+  RUN_TEST(tr, TestThreadPoolRunsParallelLikeSequential);
+  RUN_TEST(tr, TestMetricsCountQueries);
+  RUN_TEST(tr, TestRequestQueueCountsOverWindow);
+  RUN_TEST(tr, TestDuplicatesCompareWordSets);
+  RUN_TEST(tr, TestDuplicatePolicyComparesWords);
+}
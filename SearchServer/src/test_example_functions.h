@@ -4,3 +4,6 @@
 void AddDocument(SearchServer& search_server, int document_id,
                  const std::string& document, DocumentStatus status,
                  const std::vector<int>& ratings);
+
+// Runs the tests of the search server; a failed test terminates the program.
+void TestSearchServer();
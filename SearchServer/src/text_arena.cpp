@@ -0,0 +1,97 @@
+﻿#include "text_arena.h"
+
+#include <algorithm>
+
+TextArena::TextId TextArena::Add(std::string_view text) {
+  TextId text_id;
+  if (free_text_ids_.empty()) {
+    text_id = static_cast<TextId>(texts_.size());
+    texts_.emplace_back();
+  } else {
+    text_id = free_text_ids_.back();
+    free_text_ids_.pop_back();
+  }
+  texts_[text_id] = Store(text);
+  live_size_ += text.size();
+  return text_id;
+}
+
+void TextArena::Erase(TextId text_id) {
+  Text& text = texts_[text_id];
+  chunks_[text.chunk].live_size -= text.text.size();
+  live_size_ -= text.text.size();
+  garbage_size_ += text.text.size();
+  text = {};
+  free_text_ids_.push_back(text_id);
+}
+
+bool TextArena::Compact() {
+  if (garbage_size_ <= live_size_) {
+    return false;
+  }
+
+  // With more garbage than live bytes overall, at least one chunk is more
+  // than half garbage.
+  std::vector<bool> evacuated(chunks_.size());
+  for (size_t chunk = 0; chunk < chunks_.size(); ++chunk) {
+    evacuated[chunk] = chunks_[chunk].live_size * 2 < chunks_[chunk].size;
+  }
+  if (evacuated.back()) {
+    // Store must not append to a chunk that is about to be freed.
+    StartChunk(0);
+    evacuated.push_back(false);
+  }
+
+  for (Text& text : texts_) {
+    if (text.chunk != NO_CHUNK && text.chunk < evacuated.size() &&
+        evacuated[text.chunk]) {
+      text = Store(text.text);
+    }
+  }
+
+  std::vector<uint32_t> new_chunks(chunks_.size(), NO_CHUNK);
+  size_t kept = 0;
+  capacity_ = 0;
+  garbage_size_ = 0;
+  for (size_t chunk = 0; chunk < chunks_.size(); ++chunk) {
+    if (chunk < evacuated.size() && evacuated[chunk]) {
+      continue;
+    }
+    capacity_ += chunks_[chunk].capacity;
+    garbage_size_ += chunks_[chunk].size - chunks_[chunk].live_size;
+    new_chunks[chunk] = static_cast<uint32_t>(kept);
+    chunks_[kept++] = std::move(chunks_[chunk]);
+  }
+  chunks_.resize(kept);
+  for (Text& text : texts_) {
+    if (text.chunk != NO_CHUNK) {
+      text.chunk = new_chunks[text.chunk];
+    }
+  }
+  return true;
+}
+
+void TextArena::StartChunk(size_t min_capacity) {
+  const size_t last_capacity = chunks_.empty() ? 0 : chunks_.back().capacity;
+  Chunk chunk;
+  chunk.capacity = std::max(
+      min_capacity,
+      std::clamp(last_capacity * 2, MIN_CHUNK_SIZE, MAX_CHUNK_SIZE));
+  chunk.data.reset(new char[chunk.capacity]);
+  capacity_ += chunk.capacity;
+  chunks_.push_back(std::move(chunk));
+}
+
+TextArena::Text TextArena::Store(std::string_view text) {
+  if (chunks_.empty() ||
+      chunks_.back().capacity - chunks_.back().size < text.size()) {
+    StartChunk(text.size());
+  }
+  Chunk& chunk = chunks_.back();
+  char* const data = chunk.data.get() + chunk.size;
+  std::copy(text.begin(), text.end(), data);
+  chunk.size += text.size();
+  chunk.live_size += text.size();
+  return {std::string_view(data, text.size()),
+          static_cast<uint32_t>(chunks_.size() - 1)};
+}
@@ -0,0 +1,65 @@
+﻿#pragma once
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Storage for many strings in a few large append-only chunks instead of one
+// heap block per string. Every string gets a dense text id; ids of erased
+// strings are reused. Erasing leaves the bytes behind as garbage until
+// Compact moves the surviving strings out of the chunks that are mostly
+// garbage and frees them.
+class TextArena {
+ public:
+  using TextId = uint32_t;
+
+  TextArena() = default;
+  TextArena(const TextArena&) = delete;
+  TextArena& operator=(const TextArena&) = delete;
+
+  TextId Add(std::string_view text);
+  // The view stays valid until the text is erased or moved by Compact.
+  std::string_view Get(TextId text_id) const { return texts_[text_id].text; }
+  void Erase(TextId text_id);
+
+  // Does nothing until garbage makes up more than half of the stored bytes.
+  // Returns whether any text was moved.
+  bool Compact();
+
+  size_t GetLiveSize() const { return live_size_; }
+  size_t GetGarbageSize() const { return garbage_size_; }
+  // Bytes held by the chunks.
+  size_t GetCapacity() const { return capacity_; }
+
+ private:
+  static constexpr size_t MIN_CHUNK_SIZE = 4 * 1024;
+  static constexpr size_t MAX_CHUNK_SIZE = 1024 * 1024;
+  static constexpr uint32_t NO_CHUNK = std::numeric_limits<uint32_t>::max();
+
+  struct Chunk {
+    std::unique_ptr<char[]> data;
+    size_t capacity = 0;
+    size_t size = 0;
+    size_t live_size = 0;
+  };
+
+  struct Text {
+    std::string_view text;
+    // NO_CHUNK for the ids of erased texts.
+    uint32_t chunk = NO_CHUNK;
+  };
+
+  std::vector<Chunk> chunks_;
+  std::vector<Text> texts_;
+  std::vector<TextId> free_text_ids_;
+  size_t live_size_ = 0;
+  size_t garbage_size_ = 0;
+  size_t capacity_ = 0;
+
+  // Chunks grow up to MAX_CHUNK_SIZE, or to min_capacity if it is larger.
+  void StartChunk(size_t min_capacity);
+  // Copies text to the end of the last chunk, starting a new one if it does
+  // not fit.
+  Text Store(std::string_view text);
+};
@@ -0,0 +1,100 @@
+﻿#include "thread_pool.h"
+
+namespace {
+
+// Set on the workers only.
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_queue = 0;
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t thread_count) {
+  for (size_t i = 0; i < thread_count; ++i) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  for (size_t i = 0; i < thread_count; ++i) {
+    workers_.emplace_back([this, i] { RunWorker(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard guard(sleep_mutex_);
+    stopping_ = true;
+  }
+  wake_condition_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+size_t ThreadPool::GetDefaultThreadCount() {
+  return std::max(1u, std::thread::hardware_concurrency()) - 1;
+}
+
+const std::shared_ptr<ThreadPool>& ThreadPool::GetDefault() {
+  static const auto thread_pool = std::make_shared<ThreadPool>();
+  return thread_pool;
+}
+
+void ThreadPool::Push(Task task) {
+  const size_t queue = current_pool == this
+                           ? current_queue
+                           : next_queue_.fetch_add(1) % queues_.size();
+  {
+    std::lock_guard guard(queues_[queue]->mutex);
+    queues_[queue]->tasks.push_back(std::move(task));
+  }
+  queued_task_count_.fetch_add(1);
+  // A worker checks the count under the mutex, so after this it either sees
+  // the task or is already waiting for the notification.
+  {
+    std::lock_guard guard(sleep_mutex_);
+  }
+  wake_condition_.notify_one();
+}
+
+bool ThreadPool::RunTask() {
+  if (queued_task_count_.load() == 0) {
+    return false;
+  }
+  const size_t own_queue = current_pool == this ? current_queue : 0;
+  for (size_t i = 0; i < queues_.size(); ++i) {
+    Queue& queue = *queues_[(own_queue + i) % queues_.size()];
+    Task task;
+    {
+      std::lock_guard guard(queue.mutex);
+      if (queue.tasks.empty()) {
+        continue;
+      }
+      if (current_pool == this && i == 0) {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      } else {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      }
+    }
+    queued_task_count_.fetch_sub(1);
+    task();
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::RunWorker(size_t index) {
+  current_pool = this;
+  current_queue = index;
+  while (true) {
+    if (RunTask()) {
+      continue;
+    }
+    std::unique_lock lock(sleep_mutex_);
+    wake_condition_.wait(lock, [this] {
+      return stopping_ || queued_task_count_.load() > 0;
+    });
+    if (stopping_ && queued_task_count_.load() == 0) {
+      return;
+    }
+  }
+}
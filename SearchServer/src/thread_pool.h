@@ -0,0 +1,127 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with a task deque each. A worker runs its
+// newest task first and, once its deque is empty, steals the oldest task of
+// another one. A thread waiting for its ParallelFor runs tasks meanwhile
+// instead of blocking, so parallel loops may nest.
+class ThreadPool {
+ public:
+  // Tasks a loop is cut into per thread at most, so that threads that
+  // finish early have something to steal.
+  static constexpr size_t TASKS_PER_THREAD = 4;
+
+  // thread_count workers besides the threads that call ParallelFor; with 0
+  // every loop runs inline.
+  explicit ThreadPool(size_t thread_count = GetDefaultThreadCount());
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ~ThreadPool();
+
+  // Threads that work on a loop: the workers and the caller.
+  size_t GetConcurrency() const { return workers_.size() + 1; }
+
+  // Calls body(i) for every i < count, in tasks of at least grain_size
+  // consecutive indices. A loop that makes a single task runs inline on the
+  // calling thread. Returns when all calls have finished; if any of them
+  // threw, one of the exceptions is rethrown.
+  template <typename Body>
+  void ParallelFor(size_t count, size_t grain_size, Body body);
+
+  // One thread less than the hardware has, as the caller works too.
+  static size_t GetDefaultThreadCount();
+  // Pool of the servers that are not given one of their own.
+  static const std::shared_ptr<ThreadPool>& GetDefault();
+
+ private:
+  using Task = std::function<void()>;
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+  // Tasks pushed by other threads go to the queues in turn.
+  std::atomic<size_t> next_queue_ = 0;
+
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_condition_;
+  std::atomic<size_t> queued_task_count_ = 0;
+  bool stopping_ = false;
+
+  void Push(Task task);
+  // Runs a task of the own queue or a stolen one. Returns false if all
+  // queues are empty.
+  bool RunTask();
+  void RunWorker(size_t index);
+};
+
+template <typename Body>
+void ThreadPool::ParallelFor(size_t count, size_t grain_size, Body body) {
+  const size_t task_count =
+      std::min((count + std::max<size_t>(grain_size, 1) - 1) /
+                   std::max<size_t>(grain_size, 1),
+               GetConcurrency() * TASKS_PER_THREAD);
+  if (task_count <= 1 || workers_.empty()) {
+    for (size_t i = 0; i < count; ++i) {
+      body(i);
+    }
+    return;
+  }
+
+  std::atomic<size_t> pending_task_count = task_count;
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  const auto run = [&](size_t task) {
+    try {
+      for (size_t i = count * task / task_count,
+                  last = count * (task + 1) / task_count;
+           i < last; ++i) {
+        body(i);
+      }
+    } catch (...) {
+      std::lock_guard guard(error_mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+    pending_task_count.fetch_sub(1, std::memory_order_release);
+  };
+
+  for (size_t task = 1; task < task_count; ++task) {
+    Push([&run, task] { run(task); });
+  }
+  run(0);
+  while (pending_task_count.load(std::memory_order_acquire) > 0) {
+    if (!RunTask()) {
+      std::this_thread::yield();
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+// Runs on thread_pool, or inline in index order when it is nullptr.
+template <typename Body>
+void ParallelFor(ThreadPool* thread_pool, size_t count, size_t grain_size,
+                 Body body) {
+  if (thread_pool) {
+    thread_pool->ParallelFor(count, grain_size, body);
+  } else {
+    for (size_t i = 0; i < count; ++i) {
+      body(i);
+    }
+  }
+}
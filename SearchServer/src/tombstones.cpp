@@ -0,0 +1,47 @@
+﻿#include "tombstones.h"
+
+#include "search_server.h"
+
+Tombstones::Tombstones(const SearchServer& segment) : segment_(&segment) {}
+
+bool Tombstones::Contains(int document_id) const {
+  const auto ordinal = segment_->GetDocumentOrdinal(document_id);
+  if (!ordinal) {
+    return false;
+  }
+  const size_t bit = *ordinal;
+  return bit / 64 < bits_.size() && (bits_[bit / 64] >> bit % 64 & 1) != 0;
+}
+
+int Tombstones::GetDocumentFreq(std::string_view word) const {
+  const auto helper = document_freqs_.find(word);
+  return helper == document_freqs_.end() ? 0 : helper->second;
+}
+
+std::vector<int> Tombstones::GetDocumentIds() const {
+  std::vector<int> document_ids;
+  document_ids.reserve(size_);
+  for (const int document_id : *segment_) {
+    if (Contains(document_id)) {
+      document_ids.push_back(document_id);
+    }
+  }
+  return document_ids;
+}
+
+void Tombstones::Add(int document_id,
+                     const std::map<std::string_view, double>& word_freqs) {
+  const auto ordinal = segment_->GetDocumentOrdinal(document_id);
+  if (!ordinal || Contains(document_id)) {
+    return;
+  }
+  const size_t bit = *ordinal;
+  if (bits_.size() <= bit / 64) {
+    bits_.resize(bit / 64 + 1, 0);
+  }
+  bits_[bit / 64] |= uint64_t{1} << bit % 64;
+  ++size_;
+  for (const auto& [word, _] : word_freqs) {
+    ++document_freqs_[word];
+  }
+}
@@ -0,0 +1,37 @@
+﻿#pragma once
+#include <cstdint>
+#include <map>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class SearchServer;
+
+// Documents removed from an immutable segment: a bitmap over the document
+// ordinals of the segment, so its size does not depend on the ids, together
+// with the number of removed documents that contain each word, so the
+// document frequencies of the segment can be corrected without rebuilding
+// it. The words are views into the dictionary of the segment, and the
+// tombstones refer to the segment itself; both live as long as it.
+class Tombstones {
+ public:
+  explicit Tombstones(const SearchServer& segment);
+
+  bool Contains(int document_id) const;
+  size_t Size() const { return size_; }
+  int GetDocumentFreq(std::string_view word) const;
+  // Ascending.
+  std::vector<int> GetDocumentIds() const;
+
+  // word_freqs are the words of the document as
+  // SearchServer::GetWordFrequencies reports them. Adding a document twice,
+  // or one the segment does not hold, has no effect.
+  void Add(int document_id,
+           const std::map<std::string_view, double>& word_freqs);
+
+ private:
+  const SearchServer* segment_;
+  std::vector<uint64_t> bits_;
+  size_t size_ = 0;
+  std::unordered_map<std::string_view, int> document_freqs_;
+};
@@ -0,0 +1,63 @@
+﻿#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "document.h"
+
+// Keeps the best max_count documents seen so far in a bounded heap whose top
+// is the worst of them. Documents are ranked by relevance (values closer than
+// EPSILON are equal), then by rating and finally by the smaller id.
+class TopDocuments {
+ public:
+  static constexpr double EPSILON = 1e-6;
+
+  explicit TopDocuments(size_t max_count) : max_count_(max_count) {
+    heap_.reserve(max_count);
+  }
+
+  static bool IsRankedHigher(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) >= EPSILON) {
+      return lhs.relevance > rhs.relevance;
+    }
+    if (lhs.rating != rhs.rating) {
+      return lhs.rating > rhs.rating;
+    }
+    return lhs.id < rhs.id;
+  }
+
+  size_t GetMaxCount() const { return max_count_; }
+  size_t Size() const { return heap_.size(); }
+  bool IsFull() const { return heap_.size() >= max_count_; }
+
+  // The lowest ranked document kept so far; only valid if the heap is not
+  // empty.
+  const Document& Worst() const { return heap_.front(); }
+
+  void Add(const Document& document) {
+    if (!IsFull()) {
+      heap_.push_back(document);
+      std::push_heap(heap_.begin(), heap_.end(), IsRankedHigher);
+    } else if (max_count_ > 0 && IsRankedHigher(document, heap_.front())) {
+      std::pop_heap(heap_.begin(), heap_.end(), IsRankedHigher);
+      heap_.back() = document;
+      std::push_heap(heap_.begin(), heap_.end(), IsRankedHigher);
+    }
+  }
+
+  void Merge(const TopDocuments& other) {
+    for (const Document& document : other.heap_) {
+      Add(document);
+    }
+  }
+
+  // Returns the kept documents, best first, and leaves the heap empty.
+  std::vector<Document> Extract() {
+    std::sort_heap(heap_.begin(), heap_.end(), IsRankedHigher);
+    return std::move(heap_);
+  }
+
+ private:
+  size_t max_count_;
+  std::vector<Document> heap_;
+};
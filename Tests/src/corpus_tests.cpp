@@ -0,0 +1,91 @@
+﻿#include "corpus_tests.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "corpus.h"
+#include "string_processing.h"
+#include "test_framework.h"
+
+using namespace std::string_literals;
+
+namespace {
+
+CorpusOptions MakeSmallOptions() {
+  CorpusOptions options;
+  options.document_count = 500;
+  options.vocabulary_size = 1000;
+  options.min_document_words = 5;
+  options.max_document_words = 20;
+  options.stop_word_count = 10;
+  options.query_count = 200;
+  options.max_query_words = 3;
+  return options;
+}
+
+// Benchmark runs are only comparable across builds if a seed gives the same
+// corpus everywhere, so a small corpus is pinned word for word.
+void TestCorpusIsPinnedBySeed() {
+  CorpusOptions options;
+  options.document_count = 3;
+  options.vocabulary_size = 100;
+  options.min_document_words = 3;
+  options.max_document_words = 5;
+  options.stop_word_count = 2;
+  options.query_count = 2;
+  options.seed = 7;
+  const Corpus corpus = GenerateCorpus(options);
+  ASSERT_EQUAL(corpus.stop_words, "a b"s);
+  ASSERT(corpus.texts == (std::vector<std::string>{"ha g z"s, "a c k"s,
+                                                   "f b t"s}));
+  ASSERT(corpus.queries == (std::vector<std::string>{"tb d -da d"s, "d"s}));
+
+  const Corpus same = GenerateCorpus(MakeSmallOptions());
+  ASSERT(GenerateCorpus(MakeSmallOptions()).texts == same.texts);
+  CorpusOptions other_seed = MakeSmallOptions();
+  ++other_seed.seed;
+  ASSERT(GenerateCorpus(other_seed).texts != same.texts);
+}
+
+// Documents, ratings and queries stay within the options.
+void TestCorpusFollowsOptions() {
+  const CorpusOptions options = MakeSmallOptions();
+  const Corpus corpus = GenerateCorpus(options);
+  ASSERT_EQUAL(corpus.texts.size(),
+               static_cast<size_t>(options.document_count));
+  ASSERT_EQUAL(corpus.statuses.size(), corpus.texts.size());
+  ASSERT_EQUAL(corpus.ratings.size(), corpus.texts.size());
+  ASSERT_EQUAL(corpus.queries.size(),
+               static_cast<size_t>(options.query_count));
+  ASSERT_EQUAL(SplitIntoWords(corpus.stop_words).size(),
+               static_cast<size_t>(options.stop_word_count));
+
+  for (const std::string& text : corpus.texts) {
+    const int word_count = static_cast<int>(SplitIntoWords(text).size());
+    ASSERT(word_count >= options.min_document_words &&
+           word_count <= options.max_document_words);
+  }
+  for (const std::vector<int>& ratings : corpus.ratings) {
+    ASSERT(!ratings.empty());
+    ASSERT(std::all_of(ratings.begin(), ratings.end(),
+                       [](int rating) { return rating >= -5 && rating <= 5; }));
+  }
+  for (const std::string& query : corpus.queries) {
+    const int word_count = static_cast<int>(SplitIntoWords(query).size());
+    ASSERT(word_count >= 1 && word_count <= options.max_query_words);
+  }
+
+  const auto documents = corpus.GetDocuments();
+  ASSERT_EQUAL(documents.size(), corpus.texts.size());
+  ASSERT_EQUAL(documents.back().id, options.document_count - 1);
+  ASSERT_EQUAL(documents.back().text, corpus.texts.back());
+}
+
+}  // namespace
+
+void TestCorpus() {
+  TestRunner tr;
+  RUN_TEST(tr, TestCorpusIsPinnedBySeed);
+  RUN_TEST(tr, TestCorpusFollowsOptions);
+}
@@ -0,0 +1,5 @@
+﻿#pragma once
+
+// Runs the tests of the benchmark corpus generator; a failed test terminates
+// the program.
+void TestCorpus();
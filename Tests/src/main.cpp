@@ -0,0 +1,8 @@
+﻿#include "corpus_tests.h"
+#include "test_example_functions.h"
+
+int main() {
+  TestSearchServer();
+  TestCorpus();
+  return 0;
+}